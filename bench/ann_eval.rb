@@ -0,0 +1,160 @@
+# Recall / throughput evaluation of the search backends on standard
+# ANN datasets stored as fvecs, bvecs and ivecs files (SIFT, GIST, GloVe...).
+#
+#   ANN_BASE=glove-100/base.fvecs ANN_QUERY=glove-100/query.fvecs rake bench:ann
+#
+# Environment:
+#   ANN_BASE          base vectors (.fvecs or .bvecs), required
+#   ANN_QUERY         query vectors (.fvecs or .bvecs), required
+#   ANN_GROUNDTRUTH   neighbours as .ivecs; computed with the exact native scan when missing.
+#                     The library ranks by cosine similarity, so a provided file must be
+#                     angular ground truth (e.g. GloVe), not L2 (e.g. SIFT)
+#   ANN_K             neighbours per query (default 10)
+#   ANN_BACKENDS      comma-separated backends to run (default: all but database)
+#   ANN_MAX_BASE      only load the first N base vectors
+#   ANN_MAX_QUERIES   only run the first N queries
+#
+# Each backend is run once per parameter value, giving a recall@k / QPS
+# curve. Results are printed and written to bench/results/ann-*.json.
+
+require "json"
+require "time"
+require "fileutils"
+require "rag_embeddings"
+
+module AnnEval
+  # name => { build: ->(base_store, base_vectors) { index },
+  #           search: ->(index, query, k, param) { [ids] },
+  #           params: [values to sweep] }
+  # Index backends register here with the parameters worth sweeping.
+  BACKENDS = {
+    "exact" => {
+      build: ->(store, _vectors) { store },
+      search: ->(store, query, k, _param) { store.search(query, k).map(&:first) },
+      params: [nil]
+    },
+    # Full SQLite scan through Database#top_k_similar, slow: opt-in only
+    "database" => {
+      build: lambda do |_store, vectors|
+        db = RagEmbeddings::Database.new(":memory:")
+        vectors.each_slice(1000) { |slice| db.insert_many(slice.map { |packed| ["", packed.unpack("f*")] }) }
+        db
+      end,
+      search: ->(db, query, k, _param) { db.top_k_similar(query, k:).map { |id, _, _| id - 1 } },
+      params: [nil],
+      default: false
+    }
+  }
+
+  module_function
+
+  def now
+    Process.clock_gettime(Process::CLOCK_MONOTONIC)
+  end
+
+  # Yields each vector of an fvecs/bvecs/ivecs file: a little-endian int32
+  # dimension followed by that many float32, uint8 or int32 values.
+  # fvecs and bvecs vectors are yielded as packed native float32 strings,
+  # ivecs vectors as arrays of integers.
+  def each_vector(path, limit = nil)
+    return enum_for(:each_vector, path, limit) unless block_given?
+
+    width = path.end_with?(".bvecs") ? 1 : 4
+    File.open(path, "rb") do |file|
+      count = 0
+      while (header = file.read(4)) && (limit.nil? || count < limit)
+        dim = header.unpack1("l<")
+        data = file.read(dim * width)
+        raise "Truncated vector #{count} in #{path}" unless data && data.bytesize == dim * width
+
+        yield case File.extname(path)
+              when ".fvecs" then [1].pack("S") == [1].pack("v") ? data : data.unpack("e*").pack("f*")
+              when ".bvecs" then data.unpack("C*").pack("f*")
+              when ".ivecs" then data.unpack("l<*")
+              else raise ArgumentError, "Unsupported file #{path}, expected .fvecs, .bvecs or .ivecs"
+              end
+        count += 1
+      end
+    end
+  end
+
+  def optional_integer(name)
+    ENV[name] && Integer(ENV[name])
+  end
+
+  def run
+    base_path = ENV.fetch("ANN_BASE") { abort "ANN_BASE is required" }
+    query_path = ENV.fetch("ANN_QUERY") { abort "ANN_QUERY is required" }
+    k = Integer(ENV.fetch("ANN_K", "10"))
+    max_base = optional_integer("ANN_MAX_BASE")
+    max_queries = optional_integer("ANN_MAX_QUERIES")
+    names = ENV["ANN_BACKENDS"]&.split(",") || BACKENDS.reject { |_, backend| backend[:default] == false }.keys
+
+    started = now
+    base_vectors = each_vector(base_path, max_base).to_a
+    dim = base_vectors.first.bytesize / 4
+    store = RagEmbeddings::VectorStore.new(dim)
+    base_vectors.each_with_index { |packed, id| store.add_packed(id, packed) }
+    queries = each_vector(query_path, max_queries).map { |packed| RagEmbeddings::Embedding.from_array(packed.unpack("f*")) }
+    puts "Loaded #{store.size} base and #{queries.size} query vectors of #{dim} dimensions in #{(now - started).round(2)} s"
+
+    started = now
+    truth = if ENV["ANN_GROUNDTRUTH"] && max_base.nil?
+              each_vector(ENV["ANN_GROUNDTRUTH"], queries.size).map { |ids| ids.first(k) }
+            else
+              queries.map { |query| store.search(query, k).map(&:first) }
+            end
+    puts "Ground truth ready in #{(now - started).round(2)} s"
+
+    report = {
+      commit: `git -C #{__dir__} rev-parse --short HEAD 2>/dev/null`.strip,
+      time: Time.now.utc.iso8601,
+      ruby: RUBY_DESCRIPTION,
+      dataset: { base: base_path, query: query_path, size: store.size, queries: queries.size, dim: },
+      k: k,
+      results: []
+    }
+
+    puts format("%-12s %-12s %10s %10s %10s %10s", "backend", "param", "recall@#{k}", "QPS", "mean ms", "p99 ms")
+    names.each do |name|
+      backend = BACKENDS.fetch(name) { abort "Unknown backend #{name}, available: #{BACKENDS.keys.join(", ")}" }
+      build_started = now
+      index = backend[:build].call(store, base_vectors)
+      build_seconds = now - build_started
+
+      backend[:params].each do |param|
+        hits = 0
+        latencies = queries.map.with_index do |query, i|
+          query_started = now
+          ids = backend[:search].call(index, query, k, param)
+          elapsed = now - query_started
+          hits += (ids.first(k) & truth[i]).size
+          elapsed
+        end
+
+        total = latencies.sum
+        sorted = latencies.sort
+        result = {
+          backend: name,
+          param: param,
+          build_seconds: build_seconds.round(3),
+          recall: (hits.to_f / (queries.size * k)).round(4),
+          qps: (queries.size / total).round(1),
+          mean_ms: (total / queries.size * 1000.0).round(3),
+          p99_ms: (sorted[[(sorted.size * 0.99).ceil - 1, 0].max] * 1000.0).round(3)
+        }
+        report[:results] << result
+        puts format("%-12s %-12s %10.4f %10.1f %10.3f %10.3f",
+                    name, param.inspect, result[:recall], result[:qps], result[:mean_ms], result[:p99_ms])
+      end
+    end
+
+    results_dir = File.expand_path("results", __dir__)
+    FileUtils.mkdir_p(results_dir)
+    out = File.join(results_dir, "ann-#{File.basename(base_path, ".*")}-#{Time.now.strftime("%Y%m%d-%H%M%S")}.json")
+    File.write(out, JSON.pretty_generate(report))
+    puts "Results written to #{out}"
+  end
+end
+
+AnnEval.run if $PROGRAM_NAME == __FILE__
@@ -0,0 +1,142 @@
+# End-to-end benchmark of RagEmbeddings::Database on seeded synthetic data.
+#
+#   rake bench
+#   BENCH_SIZES=10000,100000 BENCH_DIM=1024 BENCH_QUERIES=50 rake bench
+#
+# For each size it builds a fresh SQLite file and measures insert throughput,
+# cold open time, top_k_similar latency percentiles and RSS, then writes all
+# the numbers to bench/results/<time>-<commit>.json so runs on different
+# commits can be compared. Vectors come from Providers::Local, so the data
+# only depends on BENCH_SEED and no network is needed.
+
+require "json"
+require "time"
+require "tmpdir"
+require "fileutils"
+require "rag_embeddings"
+
+module DatabaseBench
+  WORDS = %w[
+    vector index query cache memory latency embedding model token chunk
+    search rank score cosine sqlite native ruby thread batch disk network
+    retrieval context prompt answer document paragraph sentence corpus tenant
+  ].freeze
+
+  module_function
+
+  def env_list(name, default)
+    ENV.fetch(name, default).split(",").map { |value| Integer(value.delete("_")) }
+  end
+
+  def now
+    Process.clock_gettime(Process::CLOCK_MONOTONIC)
+  end
+
+  # Resident set size in MB, and its peak where the platform reports it
+  def memory
+    status = File.exist?("/proc/self/status") ? File.read("/proc/self/status") : ""
+    rss = status[/^VmRSS:\s+(\d+)/, 1]&.to_i || `ps -o rss= -p #{Process.pid}`.to_i
+    peak = status[/^VmHWM:\s+(\d+)/, 1]&.to_i
+    { rss_mb: (rss / 1024.0).round(2), peak_rss_mb: peak && (peak / 1024.0).round(2) }
+  end
+
+  def percentile(sorted, fraction)
+    sorted[[(sorted.size * fraction).ceil - 1, 0].max]
+  end
+
+  def synthetic_text(random, id)
+    "doc #{id} " + Array.new(12 + random.rand(12)) { WORDS[random.rand(WORDS.size)] }.join(" ")
+  end
+
+  def build(path, size, random, batch_size)
+    db = RagEmbeddings::Database.new(path)
+    started = now
+    (0...size).each_slice(batch_size) do |ids|
+      texts = ids.map { |id| synthetic_text(random, id) }
+      db.insert_many(texts.zip(RagEmbeddings.embed_batch(texts)))
+    end
+    elapsed = now - started
+    db.close
+    { rows: size, seconds: elapsed.round(3), rows_per_second: (size / elapsed).round(1) }
+  end
+
+  def query(path, queries, k, random)
+    GC.start
+    started = now
+    db = RagEmbeddings::Database.new(path)
+    open_time = now - started
+
+    texts = Array.new(queries) { |i| synthetic_text(random, "query-#{i}") }
+    latencies = texts.map do |text|
+      started = now
+      db.top_k_similar(text, k:)
+      (now - started) * 1000.0
+    end
+    db.close
+
+    sorted = latencies.sort
+    {
+      open_ms: (open_time * 1000.0).round(3),
+      first_query_ms: latencies.first.round(3),
+      queries: queries,
+      k: k,
+      p50_ms: percentile(sorted, 0.50).round(3),
+      p95_ms: percentile(sorted, 0.95).round(3),
+      p99_ms: percentile(sorted, 0.99).round(3),
+      max_ms: sorted.last.round(3)
+    }
+  end
+
+  def run
+    sizes = env_list("BENCH_SIZES", "10000,100000,1000000")
+    dim = Integer(ENV.fetch("BENCH_DIM", "768"))
+    queries = Integer(ENV.fetch("BENCH_QUERIES", "20"))
+    k = Integer(ENV.fetch("BENCH_K", "10"))
+    seed = Integer(ENV.fetch("BENCH_SEED", "42"))
+    batch_size = Integer(ENV.fetch("BENCH_BATCH", "1000"))
+    dir = ENV.fetch("BENCH_DIR") { Dir.mktmpdir("rag_embeddings_bench") }
+
+    RagEmbeddings.provider = RagEmbeddings::Providers::Local.new(dim:, seed:)
+    commit = `git -C #{__dir__} rev-parse --short HEAD 2>/dev/null`.strip
+
+    report = {
+      commit: commit,
+      time: Time.now.utc.iso8601,
+      ruby: RUBY_DESCRIPTION,
+      params: { sizes:, dim:, queries:, k:, seed:, batch_size: },
+      results: []
+    }
+
+    sizes.each do |size|
+      path = File.join(dir, "bench_#{size}.db")
+      FileUtils.rm_f(path)
+      random = Random.new(seed)
+
+      puts "== #{size} rows, #{dim} dimensions"
+      insert = build(path, size, random, batch_size)
+      puts "insert: #{insert[:rows_per_second]} rows/s"
+      search = query(path, queries, k, Random.new(seed + 1))
+      puts "open: #{search[:open_ms]} ms, first query: #{search[:first_query_ms]} ms"
+      puts "top_k_similar p50/p95/p99: #{search[:p50_ms]} / #{search[:p95_ms]} / #{search[:p99_ms]} ms"
+      mem = memory
+      puts "RSS: #{mem[:rss_mb]} MB (peak #{mem[:peak_rss_mb] || "n/a"} MB)"
+
+      report[:results] << {
+        size: size,
+        file_mb: (File.size(path) / 1024.0 / 1024.0).round(2),
+        insert: insert,
+        search: search,
+        memory: mem
+      }
+      FileUtils.rm_f(path) unless ENV["BENCH_KEEP"]
+    end
+
+    results_dir = File.expand_path("results", __dir__)
+    FileUtils.mkdir_p(results_dir)
+    out = File.join(results_dir, "#{Time.now.strftime("%Y%m%d-%H%M%S")}-#{commit.empty? ? "nogit" : commit}.json")
+    File.write(out, JSON.pretty_generate(report))
+    puts "Results written to #{out}"
+  end
+end
+
+DatabaseBench.run if $PROGRAM_NAME == __FILE__
@@ -0,0 +1,149 @@
+// Standalone benchmark of the numeric kernels of the extension
+// (ext/rag_embeddings/kernels.c), without the Ruby interpreter in the way.
+//
+//   rake bench:kernels
+//   CFLAGS="-O3 -march=native" rake bench:kernels
+//
+// For every common embedding size it reports ns per vector, cycles per
+// element and GB/s of the pair kernels on cache-resident vectors, and of
+// the batch scan over a matrix larger than the last level cache. Rows
+// suffixed /d use the kernels specialized for the size (rag_kernels_for).
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
+
+#include "kernels.h"
+
+#define MATRIX_BYTES (256u * 1024u * 1024u)   // Scan working set, well beyond any LLC
+
+static const size_t dims[] = {384, 768, 1024, 1536, 3072, 4096};
+
+// Keeps the compiler from optimizing the kernels away
+static volatile double sink;
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t cycles(void) {
+#ifdef HAVE_RDTSC
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+static void fill(float *values, size_t count, unsigned *seed) {
+  for (size_t i = 0; i < count; ++i) {
+    *seed = *seed * 1103515245u + 12345u;
+    values[i] = (float)((*seed >> 8) & 0xFFFF) / 65536.0f - 0.5f;
+  }
+}
+
+typedef struct {
+  double ns;          // Total time
+  uint64_t cycles;    // Total TSC ticks (0 when unavailable)
+} measure_t;
+
+static void report(const char *kernel, size_t dim, size_t vectors, size_t bytes, measure_t m) {
+  double ns_per_vector = m.ns / vectors;
+  double gb_per_s = bytes / m.ns;   // bytes per ns == GB/s
+  if (m.cycles) {
+    printf("%-12s %6zu %12.2f %14.3f %10.2f\n", kernel, dim, ns_per_vector,
+           (double)m.cycles / ((double)vectors * dim), gb_per_s);
+  } else {
+    printf("%-12s %6zu %12.2f %14s %10.2f\n", kernel, dim, ns_per_vector, "n/a", gb_per_s);
+  }
+}
+
+#define MEASURE(result, iterations, body) do {            \
+    double start_ns_ = now_ns();                           \
+    uint64_t start_cycles_ = cycles();                     \
+    for (size_t it_ = 0; it_ < (iterations); ++it_) { body; } \
+    (result).cycles = cycles() - start_cycles_;            \
+    (result).ns = now_ns() - start_ns_;                    \
+  } while (0)
+
+int main(int argc, char **argv) {
+  // Work per pair-kernel measurement, in vector elements
+  size_t budget = argc > 1 ? strtoull(argv[1], NULL, 10) : 200000000ull;
+  unsigned seed = 42;
+
+  printf("%-12s %6s %12s %14s %10s\n", "kernel", "dim", "ns/vector", "cycles/elem", "GB/s");
+
+  for (size_t d = 0; d < sizeof(dims) / sizeof(dims[0]); ++d) {
+    size_t dim = dims[d];
+    size_t iterations = budget / dim;
+    float *a = malloc(dim * sizeof(float));
+    float *b = malloc(dim * sizeof(float));
+    fill(a, dim, &seed);
+    fill(b, dim, &seed);
+    measure_t m;
+
+    MEASURE(m, iterations, sink = rag_cosine(a, b, dim));
+    report("cosine", dim, iterations, iterations * 2 * dim * sizeof(float), m);
+
+    MEASURE(m, iterations, sink = rag_dot(a, b, dim));
+    report("dot", dim, iterations, iterations * 2 * dim * sizeof(float), m);
+
+    MEASURE(m, iterations, sink = rag_sum_squares(a, dim));
+    report("magnitude", dim, iterations, iterations * dim * sizeof(float), m);
+
+    // Normalizing twice in a row keeps the values stable across iterations
+    MEASURE(m, iterations, sink = rag_normalize(a, dim));
+    report("normalize", dim, iterations, iterations * 2 * dim * sizeof(float), m);
+
+    // Batch scan of a query against a matrix streamed from memory
+    size_t rows = MATRIX_BYTES / (dim * sizeof(float));
+    float *matrix = malloc(rows * dim * sizeof(float));
+    float *inv_norms = malloc(rows * sizeof(float));
+    double *scores = malloc(rows * sizeof(double));
+    fill(matrix, rows * dim, &seed);
+    for (size_t r = 0; r < rows; ++r) inv_norms[r] = rag_inverse_norm(matrix + r * dim, dim);
+    float q_inv = rag_inverse_norm(b, dim);
+
+    rag_score_rows(b, q_inv, matrix, inv_norms, rows, dim, scores);   // Warm up page tables
+    MEASURE(m, 3, rag_score_rows(b, q_inv, matrix, inv_norms, rows, dim, scores));
+    sink = scores[rows - 1];
+    report("score_rows", dim, 3 * rows, 3 * rows * (dim + 1) * sizeof(float), m);
+
+    // Same scan through the kernels specialized for this size
+    const rag_kernels_t *kernels = rag_kernels_for(dim);
+    MEASURE(m, 3, kernels->score_rows(b, q_inv, matrix, inv_norms, rows, dim, scores));
+    sink = scores[rows - 1];
+    report("score_rows/d", dim, 3 * rows, 3 * rows * (dim + 1) * sizeof(float), m);
+
+    // RAG_TILE_QUERIES queries per pass over the matrix, as in a batched search
+    double *tile_scores = malloc(RAG_TILE_QUERIES * rows * sizeof(double));
+    MEASURE(m, 3, rag_score_tile(matrix, inv_norms, RAG_TILE_QUERIES, matrix, inv_norms, rows, dim, tile_scores));
+    sink = tile_scores[rows - 1];
+    report("score_tile", dim, 3 * RAG_TILE_QUERIES * rows, 3 * rows * (dim + 1) * sizeof(float), m);
+    free(tile_scores);
+
+    MEASURE(m, iterations, sink = kernels->dot(a, b, dim));
+    report("dot/d", dim, iterations, iterations * 2 * dim * sizeof(float), m);
+
+    free(matrix);
+    free(inv_norms);
+    free(scores);
+    free(a);
+    free(b);
+  }
+
+#ifdef HAVE_RDTSC
+  printf("\ncycles are TSC ticks (constant rate, not core cycles under frequency scaling)\n");
+#endif
+  return 0;
+}
@@ -0,0 +1,88 @@
+# Training workload for profile-guided optimization, run by `rake compile:pgo`
+# against the instrumented extension.
+#
+#   PGO_ROWS=20000 PGO_DIM=768 PGO_QUERIES=200 rake compile:pgo
+#
+# It walks the paths that matter in production in roughly their real
+# proportions: chunking and embedding documents, Embedding.from_array and
+# from_json_array on provider-shaped input, streaming SQLite rows through TopK,
+# and VectorStore scans. Everything is seeded, so two runs with the same
+# settings train the compiler on the same branches.
+
+require "json"
+require "tmpdir"
+require "rag_embeddings"
+
+module PgoWorkload
+  WORDS = %w[
+    vector index query cache memory latency embedding model token chunk
+    search rank score cosine sqlite native ruby thread batch disk network
+    retrieval context prompt answer document paragraph sentence corpus tenant
+    naïve café über straße 東京 データ
+  ].freeze
+
+  module_function
+
+  def env_int(name, default)
+    Integer(ENV.fetch(name, default.to_s).delete("_"))
+  end
+
+  def sentence(random)
+    Array.new(6 + random.rand(14)) { WORDS[random.rand(WORDS.size)] }.join(" ").capitalize + "."
+  end
+
+  def document(random)
+    Array.new(3 + random.rand(6)) { Array.new(2 + random.rand(5)) { sentence(random) }.join(" ") }.join("\n\n")
+  end
+
+  def run
+    rows = env_int("PGO_ROWS", 20_000)
+    dim = env_int("PGO_DIM", 768)
+    queries = env_int("PGO_QUERIES", 200)
+    k = env_int("PGO_K", 10)
+    random = Random.new(env_int("PGO_SEED", 42))
+    RagEmbeddings.provider = RagEmbeddings::Providers::Local.new(dim: dim)
+
+    # Ingest: chunk documents and embed the chunks
+    chunker = RagEmbeddings::Chunker.new(max_bytes: 600, overlap: 80)
+    texts = []
+    texts.concat(chunker.split(document(random))) while texts.size < rows
+    texts = texts.first(rows)
+    vectors = RagEmbeddings.embed_batch(texts)
+
+    # Conversions: Float and Integer arrays, embeddings, JSON bodies
+    vectors.each { |vector| RagEmbeddings::Embedding.from_array(vector) }
+    vectors.first(1_000).each { |vector| RagEmbeddings::Embedding.from_array(vector.map(&:round)) }
+    vectors.first(1_000).each do |vector|
+      RagEmbeddings::Embedding.from_json_array(JSON.generate(vector))
+      RagEmbeddings::Embedding.from_json_array(JSON.generate("embedding" => vector), "embedding")
+    end
+    embeddings = vectors.first(1_000).map { |vector| RagEmbeddings::Embedding.from_array(vector) }
+    embeddings.each_cons(2) { |a, b| a.cosine_similarity(b) }
+    embeddings.each { |embedding| embedding.magnitude }
+
+    query_vectors = Array.new(queries) { RagEmbeddings.embed(sentence(random)) }
+
+    # In-memory exact search
+    store = RagEmbeddings::VectorStore.new(dim)
+    vectors.each_with_index { |vector, id| store.add(id, vector) }
+    query_vectors.each { |query| store.search(query, k) }
+
+    # SQLite scan through the native heap
+    Dir.mktmpdir do |dir|
+      db = RagEmbeddings::Database.new(File.join(dir, "pgo.db"))
+      texts.zip(vectors).each_slice(1_000) { |batch| db.insert_many(batch) }
+      query_vectors.first([queries / 4, 1].max).each { |query| db.top_k_similar(query, k: k) }
+      db.close
+    end
+
+    # Histograms behind RagEmbeddings.metrics
+    histogram = RagEmbeddings::Histogram.new
+    100_000.times { histogram.record(random.rand * random.rand(1..1_000) / 1_000.0) }
+    RagEmbeddings::Metrics::QUANTILES.each_key { |quantile| histogram.percentile(quantile) }
+
+    puts "pgo workload: #{rows} rows, dim #{dim}, #{queries} queries"
+  end
+end
+
+PgoWorkload.run if $PROGRAM_NAME == __FILE__
@@ -0,0 +1,156 @@
+#include <ruby.h>     // Ruby API
+#include <stdint.h>   // For integer types like uint32_t
+#include <string.h>   // For memcpy
+
+#include "rag_embeddings.h"
+
+// Arena for embeddings created in bulk: one RAG_ALIGNMENT-aligned block
+// holds the headers of all the embeddings followed by their values, each
+// vector starting on its own cache line. The arena is a hidden Ruby object
+// marked by every embedding it holds, so the block is freed as a unit when
+// the last of them is collected. One allocation replaces one per embedding,
+// and the vectors of a batch end up contiguous in memory.
+typedef struct {
+  size_t bytes;         // Size of the block
+  char *block;
+} arena_t;
+
+static void arena_free(void *ptr) {
+  arena_t *arena = (arena_t *)ptr;
+  if (arena) {
+    rag_aligned_free(arena->block, arena->bytes);
+    xfree(arena);
+  }
+}
+
+static size_t arena_memsize(const void *ptr) {
+  const arena_t *arena = (const arena_t *)ptr;
+  return arena ? sizeof(arena_t) + arena->bytes : 0;
+}
+
+static const rb_data_type_t arena_type = {
+  "RagEmbeddings/Arena",
+  {0, arena_free, arena_memsize,},
+  0, 0,
+  RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+// Type of the embeddings held by an arena: they mark the arena and free
+// nothing themselves, their header and values belong to the arena block.
+// At exit Ruby frees objects in any order, so the free function must not
+// even read the header.
+static void arena_embedding_mark(void *ptr) {
+  rb_gc_mark(((const embedding_t *)ptr)->arena);
+}
+
+static const rb_data_type_t arena_embedding_type = {
+  "RagEmbeddings/Embedding (arena)",
+  {arena_embedding_mark, 0, 0,},
+  &embedding_type, 0,
+  RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+static inline size_t align_up(size_t bytes) {
+  return (bytes + RAG_ALIGNMENT - 1) & ~(size_t)(RAG_ALIGNMENT - 1);
+}
+
+// Creates the arena for `count` embeddings of the given dimensions and
+// points each header at its slot. The caller fills the values, then wraps
+// the headers with wrap_embeddings.
+static VALUE arena_new(const uint32_t *dims, long count, embedding_t **headers) {
+  size_t bytes = align_up((size_t)count * sizeof(embedding_t));
+  for (long i = 0; i < count; ++i) {
+    bytes += align_up((size_t)dims[i] * sizeof(float));
+  }
+
+  arena_t *arena;
+  VALUE obj = TypedData_Make_Struct(0, arena_t, &arena_type, arena);   // Hidden object
+  arena->block = rag_aligned_alloc(bytes);
+  arena->bytes = bytes;
+
+  embedding_t *header = (embedding_t *)arena->block;
+  char *values = arena->block + align_up((size_t)count * sizeof(embedding_t));
+  for (long i = 0; i < count; ++i, ++header) {
+    header->dim = dims[i];
+    header->values = (float *)values;
+    header->arena = obj;
+    values += align_up((size_t)dims[i] * sizeof(float));
+  }
+  *headers = (embedding_t *)arena->block;
+  return obj;
+}
+
+static VALUE wrap_embeddings(VALUE klass, VALUE arena, embedding_t *headers, long count) {
+  VALUE result = rb_ary_new_capa(count);
+  for (long i = 0; i < count; ++i) {
+    rb_ary_push(result, TypedData_Wrap_Struct(klass, &arena_embedding_type, headers + i));
+  }
+  RB_GC_GUARD(arena);
+  return result;
+}
+
+// Class method: RagEmbeddings::Embedding.from_arrays([[1.0, 2.0, ...], ...])
+// Creates one embedding per array, all sharing a single arena
+static VALUE embedding_from_arrays(VALUE klass, VALUE rb_arrays) {
+  Check_Type(rb_arrays, T_ARRAY);
+  long count = RARRAY_LEN(rb_arrays);
+  if (count == 0) return rb_ary_new();
+
+  // Check the shapes first, so nothing is allocated for a bad batch
+  VALUE tmp;
+  uint32_t *dims = ALLOCV_N(uint32_t, tmp, count);
+  for (long i = 0; i < count; ++i) {
+    VALUE array = RARRAY_AREF(rb_arrays, i);
+    Check_Type(array, T_ARRAY);
+    if (RARRAY_LEN(array) == 0) {
+      rb_raise(rb_eArgError, "Cannot create embedding from empty array (at index %ld)", i);
+    }
+    dims[i] = rag_check_dim(RARRAY_LEN(array));
+  }
+
+  embedding_t *headers;
+  VALUE arena = arena_new(dims, count, &headers);
+  ALLOCV_END(tmp);
+
+  // A non numeric value raises here; the unreferenced arena is then collected
+  for (long i = 0; i < count; ++i) {
+    rag_read_vector(RARRAY_AREF(rb_arrays, i), headers[i].values, headers[i].dim);
+  }
+  return wrap_embeddings(klass, arena, headers, count);
+}
+
+// Class method: RagEmbeddings::Embedding.from_blobs([blob, ...])
+// Same as from_arrays for native-endian float32 strings, the format of
+// Array#pack("f*") used by Database, without creating Ruby Floats
+static VALUE embedding_from_blobs(VALUE klass, VALUE rb_blobs) {
+  Check_Type(rb_blobs, T_ARRAY);
+  long count = RARRAY_LEN(rb_blobs);
+  if (count == 0) return rb_ary_new();
+
+  VALUE tmp;
+  uint32_t *dims = ALLOCV_N(uint32_t, tmp, count);
+  for (long i = 0; i < count; ++i) {
+    VALUE blob = RARRAY_AREF(rb_blobs, i);
+    Check_Type(blob, T_STRING);
+    long len = RSTRING_LEN(blob);
+    if (len == 0 || len % (long)sizeof(float) != 0) {
+      rb_raise(rb_eArgError, "Blob at index %ld has %ld bytes, not a float32 vector", i, len);
+    }
+    dims[i] = rag_check_dim(len / (long)sizeof(float));
+  }
+
+  embedding_t *headers;
+  VALUE arena = arena_new(dims, count, &headers);
+  ALLOCV_END(tmp);
+
+  for (long i = 0; i < count; ++i) {
+    VALUE blob = RARRAY_AREF(rb_blobs, i);
+    memcpy(headers[i].values, RSTRING_PTR(blob), (size_t)headers[i].dim * sizeof(float));
+  }
+  return wrap_embeddings(klass, arena, headers, count);
+}
+
+void Init_arena(VALUE cEmbedding) {
+  rb_define_singleton_method(cEmbedding, "from_arrays", embedding_from_arrays, 1);
+  rb_define_singleton_method(cEmbedding, "from_blobs", embedding_from_blobs, 1);
+}
@@ -0,0 +1,206 @@
+#include <ruby.h>     // Ruby API
+#include <stdint.h>   // For integer types like int64_t
+#include <string.h>   // For memmove
+
+#include "rag_embeddings.h"
+#include "bitmap.h"
+
+// RagEmbeddings::Bitmap, the id filter of VectorStore#search.
+// See bitmap.h for the layout and the lookups used during scans.
+
+static void bitmap_free(void *ptr) {
+  rag_bitmap_t *bitmap = (rag_bitmap_t *)ptr;
+  if (!bitmap) return;
+  for (size_t i = 0; i < bitmap->size; ++i) {
+    xfree(bitmap->containers[i].array);
+    xfree(bitmap->containers[i].bits);
+  }
+  xfree(bitmap->containers);
+  xfree(bitmap);
+}
+
+static size_t bitmap_memsize(const void *ptr) {
+  const rag_bitmap_t *bitmap = (const rag_bitmap_t *)ptr;
+  size_t bytes = sizeof(rag_bitmap_t) + bitmap->capacity * sizeof(rag_container_t);
+  for (size_t i = 0; i < bitmap->size; ++i) {
+    const rag_container_t *container = &bitmap->containers[i];
+    bytes += container->bits ? BITMAP_WORDS * sizeof(uint64_t) : container->capacity * sizeof(uint16_t);
+  }
+  return bytes;
+}
+
+static const rb_data_type_t bitmap_type = {
+  "RagEmbeddings/Bitmap",
+  {0, bitmap_free, bitmap_memsize,},
+  0, 0,
+  RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+static VALUE bitmap_alloc(VALUE klass) {
+  rag_bitmap_t *bitmap;
+  return TypedData_Make_Struct(klass, rag_bitmap_t, &bitmap_type, bitmap);
+}
+
+rag_bitmap_t *rag_get_bitmap(VALUE obj) {
+  rag_bitmap_t *bitmap;
+  TypedData_Get_Struct(obj, rag_bitmap_t, &bitmap_type, bitmap);
+  return bitmap;
+}
+
+// Container for `key`, inserted at its sorted position if missing
+static rag_container_t *find_or_insert_container(rag_bitmap_t *bitmap, int64_t key) {
+  size_t lo = 0, hi = bitmap->size;
+  // Ids usually arrive in ascending order: check the last container first
+  if (hi > 0 && bitmap->containers[hi - 1].key < key) {
+    lo = hi;
+  } else {
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (bitmap->containers[mid].key < key) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    if (lo < bitmap->size && bitmap->containers[lo].key == key) return &bitmap->containers[lo];
+  }
+
+  if (bitmap->size == bitmap->capacity) {
+    bitmap->capacity = bitmap->capacity ? bitmap->capacity * 2 : 4;
+    REALLOC_N(bitmap->containers, rag_container_t, bitmap->capacity);
+  }
+  memmove(&bitmap->containers[lo + 1], &bitmap->containers[lo], (bitmap->size - lo) * sizeof(rag_container_t));
+  bitmap->size++;
+  rag_container_t *container = &bitmap->containers[lo];
+  memset(container, 0, sizeof(*container));
+  container->key = key;
+  return container;
+}
+
+// Adds a low value to a container; returns 1 if it was not there yet
+static int container_add(rag_container_t *container, uint16_t low) {
+  if (container->bits) {
+    uint64_t mask = (uint64_t)1 << (low & 63);
+    if (container->bits[low >> 6] & mask) return 0;
+    container->bits[low >> 6] |= mask;
+    container->cardinality++;
+    return 1;
+  }
+
+  size_t position = container->cardinality;
+  if (position > 0 && container->array[position - 1] >= low) {
+    size_t lo = 0, hi = position;
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (container->array[mid] < low) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    if (container->array[lo] == low) return 0;
+    position = lo;
+  }
+
+  if (container->cardinality == BITMAP_ARRAY_MAX) {
+    // Full array: switch to a bitset, which is smaller from here on
+    uint64_t *bits = ZALLOC_N(uint64_t, BITMAP_WORDS);
+    for (size_t i = 0; i < container->cardinality; ++i) {
+      bits[container->array[i] >> 6] |= (uint64_t)1 << (container->array[i] & 63);
+    }
+    xfree(container->array);
+    container->array = NULL;
+    container->capacity = 0;
+    container->bits = bits;
+    return container_add(container, low);
+  }
+  if (container->cardinality == container->capacity) {
+    container->capacity = container->capacity ? container->capacity * 2 : 4;
+    if (container->capacity > BITMAP_ARRAY_MAX) container->capacity = BITMAP_ARRAY_MAX;
+    REALLOC_N(container->array, uint16_t, container->capacity);
+  }
+  memmove(&container->array[position + 1], &container->array[position],
+          (container->cardinality - position) * sizeof(uint16_t));
+  container->array[position] = low;
+  container->cardinality++;
+  return 1;
+}
+
+// Instance method: bitmap.add(id)
+// Also available as bitmap << id; returns self
+static VALUE bitmap_add(VALUE self, VALUE rb_id) {
+  rag_bitmap_t *bitmap = rag_get_bitmap(self);
+  rb_check_frozen(self);
+  if (bitmap->readers) {
+    rb_raise(rb_eRuntimeError, "can't modify a Bitmap while a search is using it");
+  }
+  int64_t id = NUM2LL(rb_id);
+  rag_container_t *container = find_or_insert_container(bitmap, id >> 16);
+  bitmap->cardinality += container_add(container, (uint16_t)(id & 0xFFFF));
+  return self;
+}
+
+// Instance method: bitmap.initialize(ids = nil)
+static VALUE bitmap_initialize(int argc, VALUE *argv, VALUE self) {
+  VALUE ids;
+  rb_scan_args(argc, argv, "01", &ids);
+  if (NIL_P(ids)) return self;
+
+  ids = rb_Array(ids);
+  for (long i = 0; i < RARRAY_LEN(ids); ++i) {
+    bitmap_add(self, RARRAY_AREF(ids, i));
+  }
+  return self;
+}
+
+// Instance method: bitmap.include?(id)
+static VALUE bitmap_include_p(VALUE self, VALUE rb_id) {
+  const rag_bitmap_t *bitmap = rag_get_bitmap(self);
+  int64_t id = NUM2LL(rb_id);
+  const rag_container_t *container = rag_bitmap_container(bitmap, id >> 16);
+  return container && rag_container_contains(container, (uint16_t)(id & 0xFFFF)) ? Qtrue : Qfalse;
+}
+
+// Instance method: bitmap.size
+static VALUE bitmap_size(VALUE self) {
+  return SIZET2NUM(rag_get_bitmap(self)->cardinality);
+}
+
+// Instance method: bitmap.empty?
+static VALUE bitmap_empty_p(VALUE self) {
+  return rag_get_bitmap(self)->cardinality ? Qfalse : Qtrue;
+}
+
+// Instance method: bitmap.to_a
+// Returns the ids in ascending order
+static VALUE bitmap_to_a(VALUE self) {
+  const rag_bitmap_t *bitmap = rag_get_bitmap(self);
+  VALUE result = rb_ary_new_capa((long)bitmap->cardinality);
+  for (size_t i = 0; i < bitmap->size; ++i) {
+    const rag_container_t *container = &bitmap->containers[i];
+    int64_t base = container->key * 65536;
+    if (container->bits) {
+      for (uint32_t low = 0; low < 65536; ++low) {
+        if ((container->bits[low >> 6] >> (low & 63)) & 1) rb_ary_push(result, LL2NUM(base + low));
+      }
+    } else {
+      for (uint32_t j = 0; j < container->cardinality; ++j) {
+        rb_ary_push(result, LL2NUM(base + container->array[j]));
+      }
+    }
+  }
+  return result;
+}
+
+void Init_bitmap(VALUE mRag) {
+  VALUE cBitmap = rb_define_class_under(mRag, "Bitmap", rb_cObject);
+  rb_define_alloc_func(cBitmap, bitmap_alloc);
+
+  rb_define_method(cBitmap, "initialize", bitmap_initialize, -1);
+  rb_define_method(cBitmap, "add", bitmap_add, 1);
+  rb_define_method(cBitmap, "<<", bitmap_add, 1);
+  rb_define_method(cBitmap, "include?", bitmap_include_p, 1);
+  rb_define_method(cBitmap, "size", bitmap_size, 0);
+  rb_define_method(cBitmap, "empty?", bitmap_empty_p, 0);
+  rb_define_method(cBitmap, "to_a", bitmap_to_a, 0);
+}
@@ -0,0 +1,85 @@
+#ifndef RAG_EMBEDDINGS_BITMAP_H
+#define RAG_EMBEDDINGS_BITMAP_H
+
+#include <ruby.h>     // Ruby API
+#include <stddef.h>   // For size_t
+#include <stdint.h>   // For integer types like int64_t
+
+// Roaring-style set of 64-bit ids. Ids are grouped by their high bits
+// (id >> 16) into containers kept sorted by key; a container holds the low
+// 16 bits either as a sorted array, while it has at most
+// BITMAP_ARRAY_MAX ids, or as a 65536-bit bitset. Small sets stay small and
+// dense ranges of rowids cost 1 bit each.
+#define BITMAP_ARRAY_MAX 4096
+#define BITMAP_WORDS (65536 / 64)
+
+typedef struct {
+  int64_t key;          // id >> 16
+  uint32_t cardinality;
+  uint32_t capacity;    // Allocated array slots, 0 for a bitset
+  uint16_t *array;      // Sorted low bits, or NULL for a bitset
+  uint64_t *bits;       // BITMAP_WORDS words, or NULL for an array
+} rag_container_t;
+
+typedef struct {
+  rag_container_t *containers;
+  size_t size;          // Containers in use
+  size_t capacity;
+  size_t cardinality;   // Ids in the set
+  size_t readers;       // Searches running on this set without the GVL
+} rag_bitmap_t;
+
+// Lookups through a cursor remember the last container: scans visit ids
+// mostly in ascending order, so consecutive rows usually share it.
+typedef struct {
+  const rag_bitmap_t *bitmap;
+  const rag_container_t *last;
+} rag_bitmap_cursor_t;
+
+static inline void rag_bitmap_cursor_init(rag_bitmap_cursor_t *cursor, const rag_bitmap_t *bitmap) {
+  cursor->bitmap = bitmap;
+  cursor->last = NULL;
+}
+
+// Container with the given key, or NULL
+static inline const rag_container_t *rag_bitmap_container(const rag_bitmap_t *bitmap, int64_t key) {
+  size_t lo = 0, hi = bitmap->size;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (bitmap->containers[mid].key < key) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo < bitmap->size && bitmap->containers[lo].key == key ? &bitmap->containers[lo] : NULL;
+}
+
+static inline int rag_container_contains(const rag_container_t *container, uint16_t low) {
+  if (container->bits) return (int)((container->bits[low >> 6] >> (low & 63)) & 1);
+  size_t lo = 0, hi = container->cardinality;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (container->array[mid] < low) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo < container->cardinality && container->array[lo] == low;
+}
+
+static inline int rag_bitmap_cursor_contains(rag_bitmap_cursor_t *cursor, int64_t id) {
+  int64_t key = id >> 16;
+  if (!cursor->last || cursor->last->key != key) {
+    const rag_container_t *container = rag_bitmap_container(cursor->bitmap, key);
+    if (!container) return 0;
+    cursor->last = container;
+  }
+  return rag_container_contains(cursor->last, (uint16_t)(id & 0xFFFF));
+}
+
+// Returns the set wrapped by a RagEmbeddings::Bitmap, raising TypeError otherwise
+rag_bitmap_t *rag_get_bitmap(VALUE obj);
+
+#endif
@@ -0,0 +1,79 @@
+#include <ruby.h>     // Ruby API
+
+#include "rag_embeddings.h"
+
+// Set by extconf.rb, see the build profiles documented there
+#ifndef RAG_BUILD_PROFILE
+#define RAG_BUILD_PROFILE "unknown"
+#endif
+#ifndef RAG_BUILD_FLAGS
+#define RAG_BUILD_FLAGS ""
+#endif
+#ifndef RAG_BUILD_PGO
+#define RAG_BUILD_PGO "off"
+#endif
+
+#if !defined(RAG_TARGET_CLONES_LEVELS) && !defined(RAG_TARGET_CLONES_FEATURES)
+// Instruction set the kernels were compiled for, when not multi-versioned
+static const char *compiled_isa(void) {
+#if defined(__AVX512F__)
+  return "avx512f";
+#elif defined(__AVX2__)
+  return "avx2";
+#elif defined(__AVX__)
+  return "avx";
+#elif defined(__SSE2__)
+  return "sse2";
+#elif defined(__ARM_NEON)
+  return "neon";
+#else
+  return "generic";
+#endif
+}
+#endif
+
+// Version of the target_clones kernels the loader binds on this CPU.
+// Mirrors the resolver: the first clone whose requirements the CPU meets.
+static const char *kernel_variant(void) {
+#if defined(RAG_TARGET_CLONES_LEVELS)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("x86-64-v4")) return "x86-64-v4";
+  if (__builtin_cpu_supports("x86-64-v3")) return "x86-64-v3";
+  return "default";
+#elif defined(RAG_TARGET_CLONES_FEATURES)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) return "avx512f";
+  if (__builtin_cpu_supports("avx2")) return "avx2";
+  return "default";
+#else
+  return compiled_isa();
+#endif
+}
+
+// Module method: RagEmbeddings.build_info
+// Returns { profile:, cflags:, pgo:, compiler:, target_clones:, kernel_variant:, usdt: }
+static VALUE rag_build_info(VALUE self) {
+  VALUE info = rb_hash_new();
+  rb_hash_aset(info, ID2SYM(rb_intern("profile")), rb_str_new_cstr(RAG_BUILD_PROFILE));
+  rb_hash_aset(info, ID2SYM(rb_intern("cflags")), rb_str_new_cstr(RAG_BUILD_FLAGS));
+  rb_hash_aset(info, ID2SYM(rb_intern("pgo")), rb_str_new_cstr(RAG_BUILD_PGO));
+#ifdef __VERSION__
+  rb_hash_aset(info, ID2SYM(rb_intern("compiler")), rb_str_new_cstr(__VERSION__));
+#endif
+#if defined(RAG_TARGET_CLONES_LEVELS) || defined(RAG_TARGET_CLONES_FEATURES)
+  rb_hash_aset(info, ID2SYM(rb_intern("target_clones")), Qtrue);
+#else
+  rb_hash_aset(info, ID2SYM(rb_intern("target_clones")), Qfalse);
+#endif
+  rb_hash_aset(info, ID2SYM(rb_intern("kernel_variant")), rb_str_new_cstr(kernel_variant()));
+#if defined(RAG_USDT) && defined(HAVE_SYS_SDT_H)
+  rb_hash_aset(info, ID2SYM(rb_intern("usdt")), Qtrue);
+#else
+  rb_hash_aset(info, ID2SYM(rb_intern("usdt")), Qfalse);
+#endif
+  return info;
+}
+
+void Init_build_info(VALUE mRag) {
+  rb_define_module_function(mRag, "build_info", rag_build_info, 0);
+}
@@ -0,0 +1,185 @@
+#include <ruby.h>           // Ruby API
+#include <ruby/encoding.h>  // For encoding checks
+#include <stddef.h>         // For size_t
+
+#include "rag_embeddings.h"
+
+// Boundary classes, from weakest to strongest.
+// The chunker ends a chunk on the strongest boundary it can find
+// in the second half of the window, preferring the latest one.
+enum {
+  BOUNDARY_CODEPOINT = 0,   // Never split a UTF-8 sequence
+  BOUNDARY_WORD,            // Before whitespace
+  BOUNDARY_LINE,            // After a newline
+  BOUNDARY_SENTENCE,        // After . ! ? (or their CJK full-width forms) + whitespace
+  BOUNDARY_PARAGRAPH,       // After a blank line
+  BOUNDARY_COUNT
+};
+
+typedef struct {
+  size_t max_bytes;   // Upper bound of a chunk, in bytes
+  size_t overlap;     // Bytes repeated from the end of the previous chunk
+} chunker_t;
+
+static size_t chunker_memsize(const void *ptr) {
+  return sizeof(chunker_t);
+}
+
+static const rb_data_type_t chunker_type = {
+  "RagEmbeddings/Chunker",
+  {0, RUBY_TYPED_DEFAULT_FREE, chunker_memsize,},
+  0, 0,
+  RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+static VALUE chunker_alloc(VALUE klass) {
+  chunker_t *chunker;
+  return TypedData_Make_Struct(klass, chunker_t, &chunker_type, chunker);
+}
+
+static inline int is_space(unsigned char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+// True when byte i starts a UTF-8 sequence (is not a continuation byte)
+static inline int is_codepoint_start(const unsigned char *s, size_t len, size_t i) {
+  return i >= len || (s[i] & 0xC0) != 0x80;
+}
+
+// Sentence terminator ending right before position i: ASCII . ! ?
+// or the full-width 。！？ used by CJK text (3-byte sequences)
+static inline int ends_sentence(const unsigned char *s, size_t i) {
+  if (i >= 1 && (s[i - 1] == '.' || s[i - 1] == '!' || s[i - 1] == '?')) return 1;
+  if (i >= 3) {
+    const unsigned char *p = s + i - 3;
+    if (p[0] == 0xE3 && p[1] == 0x80 && p[2] == 0x82) return 1;                  // 。
+    if (p[0] == 0xEF && p[1] == 0xBC && (p[2] == 0x81 || p[2] == 0x9F)) return 1; // ！ ？
+  }
+  return 0;
+}
+
+// Classifies position i as the (exclusive) end of a chunk
+static inline int boundary_at(const unsigned char *s, size_t len, size_t i) {
+  if (!is_codepoint_start(s, len, i)) return -1;
+  if (i >= 2 && s[i - 1] == '\n' && (s[i - 2] == '\n' || (i >= 3 && s[i - 2] == '\r' && s[i - 3] == '\n'))) {
+    return BOUNDARY_PARAGRAPH;
+  }
+  if (i < len && is_space(s[i]) && ends_sentence(s, i)) return BOUNDARY_SENTENCE;
+  if (i >= 1 && s[i - 1] == '\n') return BOUNDARY_LINE;
+  if (i < len && is_space(s[i])) return BOUNDARY_WORD;
+  return BOUNDARY_CODEPOINT;
+}
+
+// Finds where the chunk starting at `start` should end, given that the
+// text goes on past `limit`. Only the second half of the window is searched
+// so that a boundary near the start cannot produce a tiny chunk.
+static size_t find_chunk_end(const unsigned char *s, size_t len, size_t start, size_t limit) {
+  size_t best[BOUNDARY_COUNT] = {0};
+  size_t floor = start + (limit - start) / 2;
+
+  for (size_t i = limit; i > floor; --i) {
+    int kind = boundary_at(s, len, i);
+    if (kind >= 0 && best[kind] == 0) {
+      best[kind] = i;
+      if (kind == BOUNDARY_PARAGRAPH) break;
+    }
+  }
+
+  for (int kind = BOUNDARY_PARAGRAPH; kind >= 0; --kind) {
+    if (best[kind]) return best[kind];
+  }
+
+  // Nothing in the second half, not even a codepoint boundary (only
+  // possible with a tiny max_bytes): cut at the first one after start
+  size_t i = start + 1;
+  while (!is_codepoint_start(s, len, i)) ++i;
+  return i;
+}
+
+// Start of the next chunk: `overlap` bytes before the end of the previous one,
+// moved forward to the start of a word so the overlap does not begin mid-word
+static size_t find_next_start(const unsigned char *s, size_t len, size_t start, size_t end, size_t overlap) {
+  if (overlap == 0 || end - start <= overlap) return end;
+
+  size_t i = end - overlap;
+  while (i < end && !is_codepoint_start(s, len, i)) ++i;
+  if (i > 0 && !is_space(s[i - 1])) {
+    size_t word = i;
+    while (word < end && !is_space(s[word])) ++word;
+    if (word < end) i = word;
+  }
+  return i;
+}
+
+// Instance method: chunker.initialize(max_bytes: 1500, overlap: 200)
+static VALUE chunker_initialize(int argc, VALUE *argv, VALUE self) {
+  chunker_t *chunker;
+  TypedData_Get_Struct(self, chunker_t, &chunker_type, chunker);
+
+  VALUE opts;
+  rb_scan_args(argc, argv, "0:", &opts);
+
+  ID keys[2] = {rb_intern("max_bytes"), rb_intern("overlap")};
+  VALUE values[2] = {Qundef, Qundef};
+  if (!NIL_P(opts)) rb_get_kwargs(opts, keys, 0, 2, values);
+
+  long max_bytes = values[0] == Qundef ? 1500 : NUM2LONG(values[0]);
+  long overlap = values[1] == Qundef ? 200 : NUM2LONG(values[1]);
+
+  if (max_bytes <= 0) {
+    rb_raise(rb_eArgError, "max_bytes must be positive");
+  }
+  if (overlap < 0 || overlap >= max_bytes) {
+    rb_raise(rb_eArgError, "overlap must be between 0 and max_bytes - 1");
+  }
+
+  chunker->max_bytes = (size_t)max_bytes;
+  chunker->overlap = (size_t)overlap;
+  return self;
+}
+
+// Instance method: chunker.offsets(text)
+// Returns [[byte_offset, byte_length], ...] for each chunk of the text.
+// Chunks never start or end with whitespace and never split a UTF-8 sequence.
+static VALUE chunker_offsets(VALUE self, VALUE text) {
+  chunker_t *chunker;
+  TypedData_Get_Struct(self, chunker_t, &chunker_type, chunker);
+  StringValue(text);
+
+  if (!rb_enc_asciicompat(rb_enc_get(text))) {
+    rb_raise(rb_eEncCompatError, "Text must use an ASCII-compatible encoding such as UTF-8");
+  }
+
+  const unsigned char *s = (const unsigned char *)RSTRING_PTR(text);
+  size_t len = (size_t)RSTRING_LEN(text);
+  VALUE result = rb_ary_new();
+
+  size_t start = 0;
+  while (start < len && is_space(s[start])) ++start;
+
+  while (start < len) {
+    size_t end = len;
+    if (len - start > chunker->max_bytes) {
+      end = find_chunk_end(s, len, start, start + chunker->max_bytes);
+    }
+
+    size_t trimmed = end;
+    while (trimmed > start && is_space(s[trimmed - 1])) --trimmed;
+    rb_ary_push(result, rb_assoc_new(SIZET2NUM(start), SIZET2NUM(trimmed - start)));
+
+    if (end >= len) break;
+
+    start = find_next_start(s, len, start, trimmed, chunker->overlap);
+    while (start < len && is_space(s[start])) ++start;
+  }
+
+  return result;
+}
+
+void Init_chunker(VALUE mRag) {
+  VALUE cChunker = rb_define_class_under(mRag, "Chunker", rb_cObject);
+  rb_define_alloc_func(cChunker, chunker_alloc);
+
+  rb_define_method(cChunker, "initialize", chunker_initialize, -1);
+  rb_define_method(cChunker, "offsets", chunker_offsets, 1);
+}
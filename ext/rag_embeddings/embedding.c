@@ -1,31 +1,95 @@
 #include <ruby.h>     // Ruby API
-#include <stdint.h>   // For integer types like uint16_t
+#include <stdint.h>   // For integer types like uint32_t
 #include <stdlib.h>   // For memory allocation functions
 #include <math.h>     // For math functions like sqrt
+#include <string.h>   // For memcmp and memcpy
+
+#include "rag_embeddings.h"
+#include "kernels.h"
+
+void *rag_aligned_alloc(size_t bytes) {
+  void *ptr = NULL;
+  if (bytes == 0) bytes = RAG_ALIGNMENT;
+#ifdef _WIN32
+  ptr = _aligned_malloc(bytes, RAG_ALIGNMENT);
+  if (!ptr) {
+    rb_gc();          // Let the GC release what it can, then retry once
+    ptr = _aligned_malloc(bytes, RAG_ALIGNMENT);
+  }
+#else
+  if (posix_memalign(&ptr, RAG_ALIGNMENT, bytes) != 0) {
+    rb_gc();          // Let the GC release what it can, then retry once
+    if (posix_memalign(&ptr, RAG_ALIGNMENT, bytes) != 0) ptr = NULL;
+  }
+#endif
+  if (!ptr) rb_memerror();
+  rb_gc_adjust_memory_usage((ssize_t)bytes);   // Counted like xmalloc
+  return ptr;
+}
 
-// Main data structure for storing embeddings
-// Flexible array member (values[]) allows variable length arrays
-typedef struct {
-  uint16_t dim;       // Dimension of the embedding vector
-  float values[];     // Flexible array member to store the actual values
-} embedding_t;
+void rag_aligned_free(void *ptr, size_t bytes) {
+  if (!ptr) return;
+#ifdef _WIN32
+  _aligned_free(ptr);
+#else
+  free(ptr);
+#endif
+  rb_gc_adjust_memory_usage(-(ssize_t)(bytes ? bytes : RAG_ALIGNMENT));
+}
+
+// The header takes the first cache line of the block, the values start on the next one
+#define EMBEDDING_HEADER_BYTES RAG_ALIGNMENT
+
+static inline size_t embedding_bytes(uint32_t dim) {
+  return EMBEDDING_HEADER_BYTES + (size_t)dim * sizeof(float);
+}
+
+embedding_t *rag_embedding_new(uint32_t dim, int zero) {
+  embedding_t *emb = rag_aligned_alloc(embedding_bytes(dim));
+  emb->dim = dim;
+  emb->values = (float *)((char *)emb + EMBEDDING_HEADER_BYTES);
+  emb->arena = Qfalse;
+  if (zero) memset(emb->values, 0, (size_t)dim * sizeof(float));
+  return emb;
+}
+
+void rag_embedding_free(embedding_t *emb) {
+  if (emb) rag_aligned_free(emb, embedding_bytes(emb->dim));
+}
+
+uint32_t rag_check_dim(long dim) {
+  if (dim <= 0 || (unsigned long)dim > RAG_MAX_DIM) {
+    rb_raise(rb_eArgError, "Dimension must be between 1 and %u", RAG_MAX_DIM);
+  }
+  return (uint32_t)dim;
+}
+
+rag_metric_t rag_check_metric(VALUE metric) {
+  if (NIL_P(metric)) return RAG_METRIC_COSINE;
+  ID id = SYM2ID(rb_convert_type(metric, T_SYMBOL, "Symbol", "to_sym"));
+  if (id == rb_intern("cosine")) return RAG_METRIC_COSINE;
+  if (id == rb_intern("dot")) return RAG_METRIC_DOT;
+  rb_raise(rb_eArgError, "Unknown metric %+"PRIsVALUE" (expected :cosine or :dot)", metric);
+}
+
+VALUE rag_metric_sym(rag_metric_t metric) {
+  return ID2SYM(rb_intern(metric == RAG_METRIC_DOT ? "dot" : "cosine"));
+}
 
 // Callback for freeing memory when Ruby's GC collects our object
 static void embedding_free(void *ptr) {
-  if (ptr) {
-    xfree(ptr);       // Ruby's memory free function (with null check)
-  }
+  rag_embedding_free((embedding_t *)ptr);
 }
 
 // Callback to report memory usage to Ruby's GC
 static size_t embedding_memsize(const void *ptr) {
   const embedding_t *emb = (const embedding_t *)ptr;
-  return emb ? sizeof(embedding_t) + emb->dim * sizeof(float) : 0;
+  return emb ? embedding_bytes(emb->dim) : 0;
 }
 
 // Type information for Ruby's GC:
 // Tells Ruby how to manage our C data structure
-static const rb_data_type_t embedding_type = {
+const rb_data_type_t embedding_type = {
   "RagEmbeddings/Embedding",               // Type name
   {0, embedding_free, embedding_memsize,}, // Functions: mark, free, size
   0, 0,                                    // Parent type, data
@@ -39,32 +103,31 @@ static VALUE embedding_from_array(VALUE klass, VALUE rb_array) {
 
   long array_len = RARRAY_LEN(rb_array);
 
-  // Validate array length fits in uint16_t (max 65535 dimensions)
-  if (array_len > UINT16_MAX) {
-    rb_raise(rb_eArgError, "Array too large: maximum %d dimensions allowed", UINT16_MAX);
-  }
-
   // Prevent zero-length embeddings
   if (array_len == 0) {
     rb_raise(rb_eArgError, "Cannot create embedding from empty array");
   }
 
-  uint16_t dim = (uint16_t)array_len;
+  // Validate array length fits in the 32-bit dimension
+  if ((unsigned long)array_len > RAG_MAX_DIM) {
+    rb_raise(rb_eArgError, "Array too large: maximum %u dimensions allowed", RAG_MAX_DIM);
+  }
+
+  uint32_t dim = (uint32_t)array_len;
 
-  // Allocate memory for struct + array of floats
-  embedding_t *ptr = xmalloc(sizeof(embedding_t) + dim * sizeof(float));
-  ptr->dim = dim;
+  // Allocate the header and the aligned values in one block
+  embedding_t *ptr = rag_embedding_new(dim, 0);
 
   // Copy values from Ruby array to our C array
   // Using RARRAY_CONST_PTR for better performance when available
   const VALUE *array_ptr = RARRAY_CONST_PTR(rb_array);
-  for (uint16_t i = 0; i < dim; ++i) {
+  for (uint32_t i = 0; i < dim; ++i) {
     VALUE val = array_ptr[i];
 
     // Ensure the value is numeric
     if (!RB_FLOAT_TYPE_P(val) && !RB_INTEGER_TYPE_P(val)) {
-      xfree(ptr);  // Clean up allocated memory before raising exception
-      rb_raise(rb_eTypeError, "Array element at index %d is not numeric", i);
+      rag_embedding_free(ptr);  // Clean up allocated memory before raising exception
+      rb_raise(rb_eTypeError, "Array element at index %u is not numeric", i);
     }
 
     ptr->values[i] = (float)NUM2DBL(val);
@@ -75,13 +138,225 @@ static VALUE embedding_from_array(VALUE klass, VALUE rb_array) {
   return obj;
 }
 
+// Exact powers of ten representable as doubles, used by the fast path of parse_json_number
+static const double exact_powers_of_ten[] = {
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Parses a JSON number starting at p, storing it in *out.
+// Returns the position right after the number, or NULL if p does not start one.
+// Numbers with at most 19 significant digits and a small exponent (what
+// embedding APIs emit) are converted with a single exact multiplication or
+// division; anything else falls back to strtod.
+static const char *parse_json_number(const char *p, const char *end, double *out) {
+  const char *start = p;
+  int negative = 0;
+  uint64_t mantissa = 0;
+  int digits = 0;         // Significant digits accumulated in mantissa
+  int exponent = 0;       // Decimal exponent applied to mantissa
+  int truncated = 0;      // More digits than fit in mantissa
+
+  if (p < end && *p == '-') {
+    negative = 1;
+    ++p;
+  }
+  if (p >= end || *p < '0' || *p > '9') return NULL;
+
+  for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+      if (mantissa) ++digits;
+    } else {
+      ++exponent;
+      truncated = 1;
+    }
+  }
+
+  if (p < end && *p == '.') {
+    ++p;
+    if (p >= end || *p < '0' || *p > '9') return NULL;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+        if (mantissa) ++digits;
+        --exponent;
+      } else {
+        truncated = 1;
+      }
+    }
+  }
+
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    ++p;
+    int exp_negative = 0;
+    if (p < end && (*p == '+' || *p == '-')) {
+      exp_negative = (*p == '-');
+      ++p;
+    }
+    if (p >= end || *p < '0' || *p > '9') return NULL;
+    int exp_value = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+      if (exp_value < 10000) exp_value = exp_value * 10 + (*p - '0');
+    }
+    exponent += exp_negative ? -exp_value : exp_value;
+  }
+
+  // Fast path: both operands are exact doubles, so the result is correctly rounded
+  if (!truncated && mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+    double value = (double)mantissa;
+    value = exponent < 0 ? value / exact_powers_of_ten[-exponent]
+                         : value * exact_powers_of_ten[exponent];
+    *out = negative ? -value : value;
+    return p;
+  }
+
+  // Slow path: strtod on a NUL-terminated copy of the token
+  char buffer[128];
+  size_t len = (size_t)(p - start);
+  if (len >= sizeof(buffer)) return NULL;
+  memcpy(buffer, start, len);
+  buffer[len] = '\0';
+  *out = strtod(buffer, NULL);
+  return p;
+}
+
+static inline const char *skip_json_whitespace(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) ++p;
+  return p;
+}
+
+// Class method: RagEmbeddings::Embedding.from_json_array(json, key = nil)
+// Parses a JSON array of numbers straight into a new embedding, without
+// building the intermediate Ruby Array of Floats.
+// With a key, the array is the value of the first "key" member, so a whole
+// provider response can be passed:
+//   Embedding.from_json_array(body, "embedding")   # {"embedding":[...]}
+//   Embedding.from_json_array(body, "embeddings")  # {"embeddings":[[...]]} (first vector)
+static VALUE embedding_from_json_array(int argc, VALUE *argv, VALUE klass) {
+  VALUE rb_json, rb_key;
+  rb_scan_args(argc, argv, "11", &rb_json, &rb_key);
+  StringValue(rb_json);
+
+  const char *json = RSTRING_PTR(rb_json);
+  const char *end = json + RSTRING_LEN(rb_json);
+  const char *p = json;
+
+  // Locate the "key": member when one is given
+  if (!NIL_P(rb_key)) {
+    StringValue(rb_key);
+    const char *key = RSTRING_PTR(rb_key);
+    long key_len = RSTRING_LEN(rb_key);
+    const char *found = NULL;
+
+    for (; p + key_len + 2 <= end; ++p) {
+      if (*p == '"' && p[key_len + 1] == '"' && memcmp(p + 1, key, key_len) == 0) {
+        const char *colon = skip_json_whitespace(p + key_len + 2, end);
+        if (colon < end && *colon == ':') {
+          found = colon + 1;
+          break;
+        }
+      }
+    }
+    if (!found) {
+      rb_raise(rb_eArgError, "Key \"%s\" not found in JSON", StringValueCStr(rb_key));
+    }
+    p = skip_json_whitespace(found, end);
+    if (p >= end || *p != '[') {
+      rb_raise(rb_eArgError, "Value of \"%s\" is not an array", StringValueCStr(rb_key));
+    }
+  } else {
+    while (p < end && *p != '[') ++p;
+    if (p >= end) {
+      rb_raise(rb_eArgError, "No JSON array found");
+    }
+  }
+
+  // Descend into nested arrays to the first array of numbers
+  while (p < end && *p == '[') {
+    p = skip_json_whitespace(p + 1, end);
+  }
+
+  // Values are parsed into a growing buffer, then copied once into the aligned embedding
+  size_t capacity = 1024;
+  size_t dim = 0;
+  float *values = xmalloc(capacity * sizeof(float));
+
+  if (p < end && *p == ']') {
+    xfree(values);
+    rb_raise(rb_eArgError, "Cannot create embedding from empty array");
+  }
+
+  for (;;) {
+    double value;
+    const char *next = parse_json_number(p, end, &value);
+    if (!next) {
+      xfree(values);
+      rb_raise(rb_eArgError, "Invalid JSON number at byte %ld", (long)(p - json));
+    }
+
+    if (dim == RAG_MAX_DIM) {
+      xfree(values);
+      rb_raise(rb_eArgError, "Array too large: maximum %u dimensions allowed", RAG_MAX_DIM);
+    }
+    if (dim == capacity) {
+      capacity *= 2;
+      values = xrealloc2(values, capacity, sizeof(float));
+    }
+    values[dim++] = (float)value;
+
+    p = skip_json_whitespace(next, end);
+    if (p < end && *p == ',') {
+      p = skip_json_whitespace(p + 1, end);
+      continue;
+    }
+    if (p < end && *p == ']') break;
+
+    xfree(values);
+    rb_raise(rb_eArgError, "Expected ',' or ']' at byte %ld", (long)(p - json));
+  }
+
+  embedding_t *ptr = rag_embedding_new((uint32_t)dim, 0);
+  memcpy(ptr->values, values, dim * sizeof(float));
+  xfree(values);
+
+  return TypedData_Wrap_Struct(klass, &embedding_type, ptr);
+}
+
+void rag_read_vector(VALUE vector, float *out, uint32_t dim) {
+  if (rb_typeddata_is_kind_of(vector, &embedding_type)) {
+    const embedding_t *emb = (const embedding_t *)RTYPEDDATA_DATA(vector);
+    if (emb->dim != dim) {
+      rb_raise(rb_eArgError, "Dimension mismatch: %u vs %u", emb->dim, dim);
+    }
+    memcpy(out, emb->values, (size_t)dim * sizeof(float));
+    return;
+  }
+
+  if (!RB_TYPE_P(vector, T_ARRAY)) {
+    rb_raise(rb_eTypeError, "Expected an Embedding or an Array, got %s", rb_obj_classname(vector));
+  }
+  if (RARRAY_LEN(vector) != dim) {
+    rb_raise(rb_eArgError, "Dimension mismatch: %ld vs %u", RARRAY_LEN(vector), dim);
+  }
+
+  const VALUE *array_ptr = RARRAY_CONST_PTR(vector);
+  for (uint32_t i = 0; i < dim; ++i) {
+    VALUE val = array_ptr[i];
+    if (!RB_FLOAT_TYPE_P(val) && !RB_INTEGER_TYPE_P(val)) {
+      rb_raise(rb_eTypeError, "Array element at index %u is not numeric", i);
+    }
+    out[i] = (float)NUM2DBL(val);
+  }
+}
+
 // Instance method: embedding.dim
 // Returns the dimension of the embedding
 static VALUE embedding_dim(VALUE self) {
   embedding_t *ptr;
   // Get the C struct from the Ruby object
   TypedData_Get_Struct(self, embedding_t, &embedding_type, ptr);
-  return INT2NUM(ptr->dim);
+  return UINT2NUM(ptr->dim);
 }
 
 // Instance method: embedding.to_a
@@ -95,7 +370,7 @@ static VALUE embedding_to_a(VALUE self) {
 
   // Copy each float value to the Ruby array
   // Using rb_ary_store for better performance than rb_ary_push
-  for (uint16_t i = 0; i < ptr->dim; ++i) {
+  for (uint32_t i = 0; i < ptr->dim; ++i) {
     rb_ary_store(arr, i, DBL2NUM(ptr->values[i]));
   }
 
@@ -112,41 +387,11 @@ static VALUE embedding_cosine_similarity(VALUE self, VALUE other) {
 
   // Ensure dimensions match
   if (a->dim != b->dim) {
-    rb_raise(rb_eArgError, "Dimension mismatch: %d vs %d", a->dim, b->dim);
-  }
-
-  // Use double precision for intermediate calculations to reduce accumulation errors
-  double dot = 0.0, norm_a = 0.0, norm_b = 0.0;
-
-  // Calculate dot product and vector magnitudes in a single loop
-  // This is more cache-friendly than separate loops
-  const float *va = a->values;
-  const float *vb = b->values;
-
-  for (uint16_t i = 0; i < a->dim; ++i) {
-    float ai = va[i];
-    float bi = vb[i];
-
-    dot += (double)ai * bi;          // Dot product
-    norm_a += (double)ai * ai;       // Square of magnitude for vector a
-    norm_b += (double)bi * bi;       // Square of magnitude for vector b
-  }
-
-  // Check for zero vectors to avoid division by zero
-  if (norm_a == 0.0 || norm_b == 0.0) {
-    return DBL2NUM(0.0);  // Return 0 similarity for zero vectors
+    rb_raise(rb_eArgError, "Dimension mismatch: %u vs %u", a->dim, b->dim);
   }
 
-  // Apply cosine similarity formula: dot(a,b)/(|a|*|b|)
-  // Using sqrt for better numerical stability
-  double magnitude_product = sqrt(norm_a * norm_b);
-  double similarity = dot / magnitude_product;
-
-  // Clamp result to [-1, 1] to handle floating point precision errors
-  if (similarity > 1.0) similarity = 1.0;
-  if (similarity < -1.0) similarity = -1.0;
-
-  return DBL2NUM(similarity);
+  // Single pass over both vectors, 0 for zero vectors, clamped to [-1, 1]
+  return DBL2NUM(rag_cosine(a->values, b->values, a->dim));
 }
 
 // Instance method: embedding.magnitude
@@ -155,15 +400,7 @@ static VALUE embedding_magnitude(VALUE self) {
   embedding_t *ptr;
   TypedData_Get_Struct(self, embedding_t, &embedding_type, ptr);
 
-  double sum_squares = 0.0;
-  const float *values = ptr->values;
-
-  for (uint16_t i = 0; i < ptr->dim; ++i) {
-    float val = values[i];
-    sum_squares += (double)val * val;
-  }
-
-  return DBL2NUM(sqrt(sum_squares));
+  return DBL2NUM(sqrt(rag_sum_squares(ptr->values, ptr->dim)));
 }
 
 // Instance method: embedding.normalize!
@@ -172,28 +409,11 @@ static VALUE embedding_normalize_bang(VALUE self) {
   embedding_t *ptr;
   TypedData_Get_Struct(self, embedding_t, &embedding_type, ptr);
 
-  // Calculate magnitude
-  double sum_squares = 0.0;
-  float *values = ptr->values;
-
-  for (uint16_t i = 0; i < ptr->dim; ++i) {
-    float val = values[i];
-    sum_squares += (double)val * val;
-  }
-
-  double magnitude = sqrt(sum_squares);
-
   // Avoid division by zero
-  if (magnitude == 0.0) {
+  if (rag_normalize(ptr->values, ptr->dim) == 0.0) {
     rb_raise(rb_eZeroDivError, "Cannot normalize zero vector");
   }
 
-  // Normalize each component
-  float inv_magnitude = (float)(1.0 / magnitude);
-  for (uint16_t i = 0; i < ptr->dim; ++i) {
-    values[i] *= inv_magnitude;
-  }
-
   return self;  // Return self for method chaining
 }
 
@@ -210,6 +430,7 @@ void Init_embedding(void) {
 
   // Register class methods
   rb_define_singleton_method(cEmbedding, "from_array", embedding_from_array, 1);
+  rb_define_singleton_method(cEmbedding, "from_json_array", embedding_from_json_array, -1);
 
   // Register instance methods
   rb_define_method(cEmbedding, "dim", embedding_dim, 0);
@@ -217,4 +438,15 @@ void Init_embedding(void) {
   rb_define_method(cEmbedding, "cosine_similarity", embedding_cosine_similarity, 1);
   rb_define_method(cEmbedding, "magnitude", embedding_magnitude, 0);
   rb_define_method(cEmbedding, "normalize!", embedding_normalize_bang, 0);
+
+  Init_chunker(mRag);
+  Init_feature_hash(cEmbedding);
+  Init_arena(cEmbedding);
+  Init_vector_store(mRag);
+  Init_bitmap(mRag);
+  Init_fusion(mRag);
+  Init_mmr(mRag);
+  Init_topk(mRag);
+  Init_histogram(mRag);
+  Init_build_info(mRag);
 }
\ No newline at end of file
@@ -1,2 +1,100 @@
 require "mkmf"
-create_makefile("rag_embeddings/embedding")
\ No newline at end of file
+
+# Build profile, from `--with-profile=...` (gem install rag_embeddings -- --with-profile=native)
+# or the RAG_EMBEDDINGS_PROFILE environment variable (rake compile):
+#
+#   portable  (default) kernels are compiled once per x86-64 level with target_clones
+#             and the best one for the CPU is picked when the extension is loaded
+#   native    everything is compiled with -march=native, for fleets of identical hosts
+#   lto       link-time optimization, combines with the others: "native,lto"
+#
+# RagEmbeddings.build_info reports the profile and the kernel variant in use.
+PROFILES = %w[portable native lto].freeze
+
+profile = (with_config("profile") || ENV["RAG_EMBEDDINGS_PROFILE"] || "portable").split(",").map(&:strip)
+unknown = profile - PROFILES
+abort "Unknown build profile #{unknown.join(", ")}, expected a combination of #{PROFILES.join(", ")}" if unknown.any?
+native = profile.include?("native")
+lto = profile.include?("lto")
+
+# -fopenmp-simd only enables the `#pragma omp simd` reductions of kernels.c (no OpenMP runtime),
+# -fno-math-errno lets sqrt be inlined
+flags = %w[-O3 -fopenmp-simd -fno-math-errno]
+flags += %w[-march=native -mtune=native] if native
+flags << "-flto" if lto
+flags = flags.select { |flag| try_cflags(flag) }
+
+# Profile-guided optimization, driven by `rake compile:pgo`: a first build with
+# --with-pgo=generate writes execution counts to --with-pgo-dir while
+# bench/pgo_workload.rb runs, the second build with --with-pgo=use optimizes
+# branches, inlining and loop layout from them
+pgo = with_config("pgo") || ENV["RAG_EMBEDDINGS_PGO"]
+pgo_dir = File.expand_path(with_config("pgo-dir") || ENV["RAG_EMBEDDINGS_PGO_DIR"] || "../../tmp/pgo", __dir__)
+clang = checking_for("clang") { try_compile("#ifndef __clang__\n#error not clang\n#endif\nint main(void) { return 0; }") }
+pgo_flags =
+  case pgo
+  when nil, "", "off"
+    pgo = nil
+    []
+  when "generate"
+    FileUtils.mkdir_p(pgo_dir)
+    ["-fprofile-generate=#{pgo_dir}", "-fprofile-update=prefer-atomic"]
+  when "use"
+    if clang
+      # clang writes raw profiles that have to be merged first
+      raw = Dir[File.join(pgo_dir, "*.profraw")]
+      abort "No profile in #{pgo_dir}, build with --with-pgo=generate and run the workload first" if raw.empty?
+      system("llvm-profdata", "merge", "-o", File.join(pgo_dir, "default.profdata"), *raw, exception: true)
+      ["-fprofile-use=#{File.join(pgo_dir, "default.profdata")}", "-Wno-profile-instr-unprofiled"]
+    else
+      abort "No profile in #{pgo_dir}, build with --with-pgo=generate and run the workload first" if Dir[File.join(pgo_dir, "*.gcda")].empty?
+      # partial training keeps functions the workload never reached optimized for speed
+      ["-fprofile-use=#{pgo_dir}", "-fprofile-partial-training", "-fprofile-correction", "-Wno-missing-profile"]
+    end
+  else
+    abort "Unknown PGO mode #{pgo}, expected generate, use or off"
+  end
+if pgo
+  # the -fprofile-use flags are not probed: the test program has no profile and would warn
+  abort "The compiler does not support profile-guided optimization" unless try_cflags("-fprofile-generate")
+  pgo_flags.reject! { |flag| flag.start_with?("-fprofile-partial-training", "-fprofile-update") && !try_cflags(flag) }
+end
+flags += pgo_flags
+
+$CFLAGS << " " << flags.join(" ")
+$LDFLAGS << " -flto" if flags.include?("-flto")
+# the instrumented build links the profiling runtime
+$LDFLAGS << " " << pgo_flags.first if pgo == "generate"
+
+# Function multi-versioning of the kernels: x86-64-v4 / v3 levels on recent
+# compilers, AVX-512 / AVX2 on older ones, nothing when -march=native already
+# targets the host. Nor with PGO: the ifunc resolvers of an instrumented build
+# run before the profiling runtime is set up and crash the extension on load
+# (GCC 12), and both PGO builds have to compile the same functions
+TARGET_CLONES_TEST = <<~C
+  __attribute__((target_clones(%s)))
+  int kernel(int x) { return x + 1; }
+  int main(void) { return kernel(-1); }
+C
+unless native || pgo
+  if try_link(format(TARGET_CLONES_TEST, '"arch=x86-64-v4", "arch=x86-64-v3", "default"'))
+    $defs << "-DRAG_TARGET_CLONES_LEVELS"
+  elsif try_link(format(TARGET_CLONES_TEST, '"avx512f", "avx2", "default"'))
+    $defs << "-DRAG_TARGET_CLONES_FEATURES"
+  end
+end
+
+# VectorStore.map shares store files between processes with mmap
+have_header("sys/mman.h")
+
+# USDT probes (see probes.h): on by default where <sys/sdt.h> exists,
+# `gem install rag_embeddings -- --disable-usdt` to leave them out
+if enable_config("usdt", true) && have_header("sys/sdt.h")
+  $defs << "-DRAG_USDT"
+end
+
+$defs << %('-DRAG_BUILD_PROFILE="#{profile.join(",")}"')
+$defs << %('-DRAG_BUILD_FLAGS="#{flags.join(" ")}"')
+$defs << %('-DRAG_BUILD_PGO="#{pgo}"') if pgo
+
+create_makefile("rag_embeddings/embedding")
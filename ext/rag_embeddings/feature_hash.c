@@ -0,0 +1,98 @@
+#include <ruby.h>     // Ruby API
+#include <stdint.h>   // For integer types like uint64_t
+
+#include "rag_embeddings.h"
+#include "kernels.h"
+
+// Deterministic, offline embeddings using the hashing trick:
+// every token and every run of up to `ngram` consecutive tokens is hashed
+// to a dimension and a sign, the counts are summed and the vector is
+// L2-normalized. Texts sharing words get a positive cosine similarity,
+// which is all benchmarks and tests need, and no model or network is involved.
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
+#define MAX_NGRAM  8
+
+// Final mix of splitmix64, spreads FNV hashes over all 64 bits
+static inline uint64_t mix64(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+// Token bytes: ASCII letters and digits, plus any non-ASCII byte so that
+// UTF-8 words stay whole. Everything else separates tokens.
+static inline int is_token_byte(unsigned char c) {
+  return c >= 0x80 || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static inline unsigned char ascii_downcase(unsigned char c) {
+  return (c >= 'A' && c <= 'Z') ? (unsigned char)(c + ('a' - 'A')) : c;
+}
+
+static inline void add_feature(float *values, uint32_t dim, uint64_t hash) {
+  uint64_t h = mix64(hash);
+  values[h % dim] += (h >> 63) ? -1.0f : 1.0f;
+}
+
+// Class method: RagEmbeddings::Embedding.feature_hash(text, dim, seed = 0, ngram = 2)
+// Returns the normalized feature-hashing embedding of the text
+static VALUE embedding_feature_hash(int argc, VALUE *argv, VALUE klass) {
+  VALUE rb_text, rb_dim, rb_seed, rb_ngram;
+  rb_scan_args(argc, argv, "22", &rb_text, &rb_dim, &rb_seed, &rb_ngram);
+  StringValue(rb_text);
+
+  uint32_t dim = rag_check_dim(NUM2LONG(rb_dim));
+  uint64_t seed = NIL_P(rb_seed) ? 0 : NUM2ULL(rb_seed);
+  int ngram = NIL_P(rb_ngram) ? 2 : NUM2INT(rb_ngram);
+  if (ngram < 1 || ngram > MAX_NGRAM) {
+    rb_raise(rb_eArgError, "ngram must be between 1 and %d", MAX_NGRAM);
+  }
+
+  embedding_t *ptr = rag_embedding_new(dim, 1);
+
+  const unsigned char *s = (const unsigned char *)RSTRING_PTR(rb_text);
+  long len = RSTRING_LEN(rb_text);
+  uint64_t seed_hash = mix64(seed ^ FNV_OFFSET);
+
+  // Hashes of the last `ngram` tokens, most recent first
+  uint64_t window[MAX_NGRAM];
+  int window_size = 0;
+
+  for (long i = 0; i < len;) {
+    while (i < len && !is_token_byte(s[i])) ++i;
+    if (i >= len) break;
+
+    uint64_t hash = seed_hash;
+    while (i < len && is_token_byte(s[i])) {
+      hash ^= ascii_downcase(s[i++]);
+      hash *= FNV_PRIME;
+    }
+
+    for (int j = (window_size < ngram ? window_size : ngram - 1); j > 0; --j) {
+      window[j] = window[j - 1];
+    }
+    window[0] = hash;
+    if (window_size < ngram) ++window_size;
+
+    // Unigram, then the n-grams ending at this token
+    uint64_t combined = hash;
+    add_feature(ptr->values, dim, combined);
+    for (int j = 1; j < window_size; ++j) {
+      combined = (combined ^ window[j]) * FNV_PRIME + (uint64_t)j;
+      add_feature(ptr->values, dim, combined);
+    }
+  }
+
+  rag_normalize(ptr->values, dim);
+
+  return TypedData_Wrap_Struct(klass, &embedding_type, ptr);
+}
+
+void Init_feature_hash(VALUE cEmbedding) {
+  rb_define_singleton_method(cEmbedding, "feature_hash", embedding_feature_hash, -1);
+}
@@ -0,0 +1,150 @@
+#include <ruby.h>     // Ruby API
+#include <stdint.h>   // For integer types like int64_t
+#include <stdlib.h>   // For qsort
+
+#include "rag_embeddings.h"
+#include "topk.h"
+
+// Rank fusion for hybrid search: several rankings of the same rows (e.g.
+// BM25 and vector similarity) are merged into one. Every (id, contribution)
+// pair goes into one array, which is sorted by id to sum the contributions
+// of each row, and the bounded heap of topk.h keeps the k best sums.
+
+#define DEFAULT_RRF_K 60
+
+typedef struct {
+  int64_t id;
+  double score;
+} fused_row_t;
+
+static int compare_ids(const void *a, const void *b) {
+  int64_t x = ((const fused_row_t *)a)->id;
+  int64_t y = ((const fused_row_t *)b)->id;
+  return (x > y) - (x < y);
+}
+
+// Class method: RagEmbeddings.fuse(rankings, k:, weights: nil, method: :rrf, rrf_k: 60)
+// Each ranking is [[id, score], ...], best first. Returns the k best
+// [[id, fused_score], ...] by decreasing fused score, where a row gets
+//   :rrf       sum of weight / (rrf_k + rank), rank starting at 1
+//   :weighted  sum of weight * score, scores min-max normalized per ranking
+// Weights default to 1 for every ranking; rows missing from a ranking get
+// nothing from it.
+static VALUE rag_fuse(int argc, VALUE *argv, VALUE self) {
+  VALUE rankings, opts;
+  rb_scan_args(argc, argv, "1:", &rankings, &opts);
+  Check_Type(rankings, T_ARRAY);
+
+  static ID keywords[4];
+  if (!keywords[0]) {
+    keywords[0] = rb_intern("k");
+    keywords[1] = rb_intern("weights");
+    keywords[2] = rb_intern("method");
+    keywords[3] = rb_intern("rrf_k");
+  }
+  VALUE values[4];
+  rb_get_kwargs(opts, keywords, 1, 3, values);
+
+  long k = NUM2LONG(values[0]);
+  if (k < 0) {
+    rb_raise(rb_eArgError, "k must not be negative");
+  }
+  VALUE weights = values[1] == Qundef ? Qnil : values[1];
+  if (!NIL_P(weights)) {
+    Check_Type(weights, T_ARRAY);
+    if (RARRAY_LEN(weights) != RARRAY_LEN(rankings)) {
+      rb_raise(rb_eArgError, "Got %ld weights for %ld rankings", RARRAY_LEN(weights), RARRAY_LEN(rankings));
+    }
+  }
+  int weighted = 0;
+  if (values[2] != Qundef && !NIL_P(values[2])) {
+    ID method = SYM2ID(rb_convert_type(values[2], T_SYMBOL, "Symbol", "to_sym"));
+    if (method == rb_intern("weighted")) {
+      weighted = 1;
+    } else if (method != rb_intern("rrf")) {
+      rb_raise(rb_eArgError, "Unknown fusion method %+"PRIsVALUE" (expected :rrf or :weighted)", values[2]);
+    }
+  }
+  double rrf_k = values[3] == Qundef || NIL_P(values[3]) ? DEFAULT_RRF_K : NUM2DBL(values[3]);
+  if (!(rrf_k >= 0.0)) {
+    rb_raise(rb_eArgError, "rrf_k must not be negative");
+  }
+
+  long total = 0;
+  for (long i = 0; i < RARRAY_LEN(rankings); ++i) {
+    VALUE ranking = RARRAY_AREF(rankings, i);
+    Check_Type(ranking, T_ARRAY);
+    total += RARRAY_LEN(ranking);
+  }
+
+  VALUE tmp_rows, tmp_hits;
+  fused_row_t *rows = ALLOCV_N(fused_row_t, tmp_rows, total ? total : 1);
+  long count = 0;
+  for (long i = 0; i < RARRAY_LEN(rankings); ++i) {
+    VALUE ranking = RARRAY_AREF(rankings, i);
+    double weight = NIL_P(weights) ? 1.0 : NUM2DBL(RARRAY_AREF(weights, i));
+    long size = RARRAY_LEN(ranking);
+    if (size > total - count) size = total - count;   // Changed by a conversion callback
+
+    // Range of the scores, for the weighted method
+    double lo = 0.0, hi = 0.0;
+    for (long r = 0; r < size; ++r) {
+      VALUE hit = RARRAY_AREF(ranking, r);
+      Check_Type(hit, T_ARRAY);
+      if (RARRAY_LEN(hit) < 1) {
+        rb_raise(rb_eArgError, "Ranking entries must be [id, score]");
+      }
+      rows[count + r].id = NUM2LL(RARRAY_AREF(hit, 0));
+      if (weighted) {
+        if (RARRAY_LEN(hit) < 2) {
+          rb_raise(rb_eArgError, "Ranking entries must be [id, score]");
+        }
+        double score = NUM2DBL(RARRAY_AREF(hit, 1));
+        rows[count + r].score = score;
+        if (r == 0 || score < lo) lo = score;
+        if (r == 0 || score > hi) hi = score;
+      }
+    }
+    for (long r = 0; r < size; ++r) {
+      double contribution;
+      if (weighted) {
+        contribution = hi > lo ? (rows[count + r].score - lo) / (hi - lo) : 1.0;
+      } else {
+        contribution = 1.0 / (rrf_k + (double)(r + 1));
+      }
+      rows[count + r].score = weight * contribution;
+    }
+    count += size;
+  }
+
+  // Sum the contributions of each id, compacting the array in place
+  qsort(rows, (size_t)count, sizeof(fused_row_t), compare_ids);
+  long unique = 0;
+  for (long i = 0; i < count; ++i) {
+    if (unique > 0 && rows[unique - 1].id == rows[i].id) {
+      rows[unique - 1].score += rows[i].score;
+    } else {
+      rows[unique++] = rows[i];
+    }
+  }
+
+  if (k > unique) k = unique;
+  rag_topk_t topk;
+  rag_topk_init(&topk, ALLOCV_N(rag_hit_t, tmp_hits, k ? k : 1), (size_t)k);
+  for (long i = 0; i < unique; ++i) {
+    rag_topk_push(&topk, rows[i].score, (size_t)i);
+  }
+  rag_topk_sort(&topk);
+
+  VALUE result = rb_ary_new_capa((long)topk.size);
+  for (size_t i = 0; i < topk.size; ++i) {
+    rb_ary_push(result, rb_assoc_new(LL2NUM(rows[topk.hits[i].index].id), DBL2NUM(topk.hits[i].score)));
+  }
+  ALLOCV_END(tmp_rows);
+  ALLOCV_END(tmp_hits);
+  return result;
+}
+
+void Init_fusion(VALUE mRag) {
+  rb_define_module_function(mRag, "fuse", rag_fuse, -1);
+}
@@ -0,0 +1,150 @@
+#include <ruby.h>     // Ruby API
+#include <stdint.h>   // For integer types like uint64_t
+#include <string.h>   // For memset
+#include <math.h>     // For ceil
+
+#include "rag_embeddings.h"
+
+// HDR-style latency histogram with log-linear buckets over nanoseconds.
+// Values below SUB_BUCKETS ns get one bucket each; above that, every power
+// of two is split into SUB_BUCKETS linear buckets, so any recorded value is
+// known within 1/SUB_BUCKETS (~3%) from 1 ns up to centuries, in a fixed
+// 15 KB array. Recording is O(1) and never allocates.
+
+#define SUB_BUCKET_BITS 5
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+#define BUCKET_COUNT (SUB_BUCKETS + (64 - SUB_BUCKET_BITS) * SUB_BUCKETS)
+
+typedef struct {
+  uint64_t counts[BUCKET_COUNT];
+  uint64_t count;
+  uint64_t min_ns;
+  uint64_t max_ns;
+  double sum_ns;
+} histogram_t;
+
+static size_t histogram_memsize(const void *ptr) {
+  return sizeof(histogram_t);
+}
+
+static const rb_data_type_t histogram_type = {
+  "RagEmbeddings/Histogram",
+  {0, RUBY_TYPED_DEFAULT_FREE, histogram_memsize,},
+  0, 0,
+  RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+static void histogram_clear(histogram_t *h) {
+  memset(h, 0, sizeof(*h));
+  h->min_ns = UINT64_MAX;
+}
+
+static VALUE histogram_alloc(VALUE klass) {
+  histogram_t *h;
+  VALUE obj = TypedData_Make_Struct(klass, histogram_t, &histogram_type, h);
+  histogram_clear(h);
+  return obj;
+}
+
+static histogram_t *get_histogram(VALUE self) {
+  histogram_t *h;
+  TypedData_Get_Struct(self, histogram_t, &histogram_type, h);
+  return h;
+}
+
+static inline int bucket_index(uint64_t ns) {
+  if (ns < SUB_BUCKETS) return (int)ns;
+  int exponent = 63 - __builtin_clzll(ns);   // >= SUB_BUCKET_BITS
+  int sub = (int)((ns >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+  return SUB_BUCKETS + (exponent - SUB_BUCKET_BITS) * SUB_BUCKETS + sub;
+}
+
+// Middle of the range of values counted by a bucket
+static inline double bucket_value(int index) {
+  if (index < SUB_BUCKETS) return (double)index;
+  int exponent = (index - SUB_BUCKETS) / SUB_BUCKETS + SUB_BUCKET_BITS;
+  int sub = (index - SUB_BUCKETS) % SUB_BUCKETS;
+  double width = ldexp(1.0, exponent - SUB_BUCKET_BITS);
+  return ldexp(1.0, exponent) + sub * width + width / 2.0;
+}
+
+// Instance method: histogram.record(seconds)
+static VALUE histogram_record(VALUE self, VALUE rb_seconds) {
+  histogram_t *h = get_histogram(self);
+  double seconds = NUM2DBL(rb_seconds);
+  uint64_t ns = seconds <= 0.0 ? 0 : (seconds >= 1.8e10 ? UINT64_MAX : (uint64_t)(seconds * 1e9));
+
+  h->counts[bucket_index(ns)]++;
+  h->count++;
+  h->sum_ns += (double)ns;
+  if (ns < h->min_ns) h->min_ns = ns;
+  if (ns > h->max_ns) h->max_ns = ns;
+  return self;
+}
+
+// Instance method: histogram.percentile(quantile)
+// Returns the value in seconds below which `quantile` (0.0 - 1.0) of the
+// recorded values fall, or 0.0 when nothing was recorded
+static VALUE histogram_percentile(VALUE self, VALUE rb_quantile) {
+  histogram_t *h = get_histogram(self);
+  double quantile = NUM2DBL(rb_quantile);
+  if (quantile < 0.0 || quantile > 1.0) {
+    rb_raise(rb_eArgError, "quantile must be between 0.0 and 1.0");
+  }
+  if (h->count == 0) return DBL2NUM(0.0);
+
+  uint64_t target = (uint64_t)ceil(quantile * (double)h->count);
+  if (target == 0) target = 1;
+
+  uint64_t seen = 0;
+  for (int i = 0; i < BUCKET_COUNT; ++i) {
+    seen += h->counts[i];
+    if (seen >= target) {
+      double value = bucket_value(i);
+      if (value < (double)h->min_ns) value = (double)h->min_ns;
+      if (value > (double)h->max_ns) value = (double)h->max_ns;
+      return DBL2NUM(value / 1e9);
+    }
+  }
+  return DBL2NUM((double)h->max_ns / 1e9);
+}
+
+// Instance method: histogram.count
+static VALUE histogram_count(VALUE self) {
+  return ULL2NUM(get_histogram(self)->count);
+}
+
+// Instance method: histogram.sum (seconds)
+static VALUE histogram_sum(VALUE self) {
+  return DBL2NUM(get_histogram(self)->sum_ns / 1e9);
+}
+
+// Instance method: histogram.min (seconds)
+static VALUE histogram_min(VALUE self) {
+  histogram_t *h = get_histogram(self);
+  return DBL2NUM(h->count ? (double)h->min_ns / 1e9 : 0.0);
+}
+
+// Instance method: histogram.max (seconds)
+static VALUE histogram_max(VALUE self) {
+  return DBL2NUM((double)get_histogram(self)->max_ns / 1e9);
+}
+
+// Instance method: histogram.reset
+static VALUE histogram_reset(VALUE self) {
+  histogram_clear(get_histogram(self));
+  return self;
+}
+
+void Init_histogram(VALUE mRag) {
+  VALUE cHistogram = rb_define_class_under(mRag, "Histogram", rb_cObject);
+  rb_define_alloc_func(cHistogram, histogram_alloc);
+
+  rb_define_method(cHistogram, "record", histogram_record, 1);
+  rb_define_method(cHistogram, "percentile", histogram_percentile, 1);
+  rb_define_method(cHistogram, "count", histogram_count, 0);
+  rb_define_method(cHistogram, "sum", histogram_sum, 0);
+  rb_define_method(cHistogram, "min", histogram_min, 0);
+  rb_define_method(cHistogram, "max", histogram_max, 0);
+  rb_define_method(cHistogram, "reset", histogram_reset, 0);
+}
@@ -0,0 +1,181 @@
+#include <math.h>     // For sqrt
+
+#include "kernels.h"
+
+// The loops live in static inline helpers so that every public kernel,
+// including each of its target_clones versions, gets its own inlined and
+// vectorized copy instead of calling another dispatched function.
+
+static inline double dot_loop(const float *a, const float *b, size_t dim) {
+  double dot = 0.0;
+#pragma omp simd reduction(+:dot)
+  for (size_t i = 0; i < dim; ++i) {
+    dot += (double)a[i] * b[i];
+  }
+  return dot;
+}
+
+static inline double sum_squares_loop(const float *a, size_t dim) {
+  double sum_squares = 0.0;
+#pragma omp simd reduction(+:sum_squares)
+  for (size_t i = 0; i < dim; ++i) {
+    sum_squares += (double)a[i] * a[i];
+  }
+  return sum_squares;
+}
+
+// Fixed-size versions for the specialized kernels. `dim` is a compile-time
+// constant multiple of FIXED_LANES there: the inner loop becomes a few
+// vector accumulators with independent dependency chains, so the additions
+// do not wait on each other, and there is no tail to handle.
+#define FIXED_LANES 16
+
+static inline double dot_fixed(const float *a, const float *b, size_t dim) {
+  double acc[FIXED_LANES] = {0};
+  for (size_t i = 0; i < dim; i += FIXED_LANES) {
+    for (size_t j = 0; j < FIXED_LANES; ++j) {
+      acc[j] += (double)a[i + j] * b[i + j];
+    }
+  }
+  double dot = 0.0;
+  for (size_t j = 0; j < FIXED_LANES; ++j) dot += acc[j];
+  return dot;
+}
+
+static inline double sum_squares_fixed(const float *a, size_t dim) {
+  return dot_fixed(a, a, dim);
+}
+
+RAG_KERNEL
+double rag_dot(const float *a, const float *b, size_t dim) {
+  return dot_loop(a, b, dim);
+}
+
+RAG_KERNEL
+double rag_sum_squares(const float *a, size_t dim) {
+  return sum_squares_loop(a, dim);
+}
+
+RAG_KERNEL
+double rag_cosine(const float *a, const float *b, size_t dim) {
+  // Dot product and both magnitudes in a single loop, kinder to the cache
+  double dot = 0.0, norm_a = 0.0, norm_b = 0.0;
+#pragma omp simd reduction(+:dot, norm_a, norm_b)
+  for (size_t i = 0; i < dim; ++i) {
+    float ai = a[i];
+    float bi = b[i];
+    dot += (double)ai * bi;
+    norm_a += (double)ai * ai;
+    norm_b += (double)bi * bi;
+  }
+
+  if (norm_a == 0.0 || norm_b == 0.0) return 0.0;
+
+  double similarity = dot / sqrt(norm_a * norm_b);
+  if (similarity > 1.0) similarity = 1.0;
+  if (similarity < -1.0) similarity = -1.0;
+  return similarity;
+}
+
+RAG_KERNEL
+float rag_inverse_norm(const float *a, size_t dim) {
+  double norm = sqrt(sum_squares_loop(a, dim));
+  return norm == 0.0 ? 0.0f : (float)(1.0 / norm);
+}
+
+RAG_KERNEL
+double rag_normalize(float *a, size_t dim) {
+  double magnitude = sqrt(sum_squares_loop(a, dim));
+  if (magnitude == 0.0) return 0.0;
+
+  float inv_magnitude = (float)(1.0 / magnitude);
+#pragma omp simd
+  for (size_t i = 0; i < dim; ++i) {
+    a[i] *= inv_magnitude;
+  }
+  return magnitude;
+}
+
+RAG_KERNEL
+void rag_score_rows(const float *query, float query_inv_norm,
+                    const float *rows, const float *row_inv_norms,
+                    size_t count, size_t dim, double *scores) {
+  for (size_t r = 0; r < count; ++r, rows += dim) {
+    scores[r] = dot_loop(query, rows, dim) * query_inv_norm * row_inv_norms[r];
+  }
+}
+
+RAG_KERNEL
+void rag_score_tile(const float *queries, const float *query_inv_norms, size_t query_count,
+                    const float *rows, const float *row_inv_norms,
+                    size_t count, size_t dim, double *scores) {
+  size_t q = 0;
+  for (; q + RAG_TILE_QUERIES <= query_count; q += RAG_TILE_QUERIES) {
+    const float *q0 = queries + q * dim;
+    const float *q1 = q0 + dim;
+    const float *q2 = q1 + dim;
+    const float *q3 = q2 + dim;
+    const float *row = rows;
+    for (size_t r = 0; r < count; ++r, row += dim) {
+      // One pass over the row feeds four independent accumulators
+      double dot0 = 0.0, dot1 = 0.0, dot2 = 0.0, dot3 = 0.0;
+#pragma omp simd reduction(+:dot0, dot1, dot2, dot3)
+      for (size_t i = 0; i < dim; ++i) {
+        double value = row[i];
+        dot0 += value * q0[i];
+        dot1 += value * q1[i];
+        dot2 += value * q2[i];
+        dot3 += value * q3[i];
+      }
+      scores[q * count + r] = dot0 * query_inv_norms[q] * row_inv_norms[r];
+      scores[(q + 1) * count + r] = dot1 * query_inv_norms[q + 1] * row_inv_norms[r];
+      scores[(q + 2) * count + r] = dot2 * query_inv_norms[q + 2] * row_inv_norms[r];
+      scores[(q + 3) * count + r] = dot3 * query_inv_norms[q + 3] * row_inv_norms[r];
+    }
+  }
+  // Remaining queries, one at a time
+  for (; q < query_count; ++q) {
+    const float *row = rows;
+    for (size_t r = 0; r < count; ++r, row += dim) {
+      scores[q * count + r] = dot_loop(queries + q * dim, row, dim) * query_inv_norms[q] * row_inv_norms[r];
+    }
+  }
+}
+
+// Generic kernels, for any size
+static const rag_kernels_t generic_kernels = {
+  0, rag_dot, rag_inverse_norm, rag_score_rows
+};
+
+// One set of kernels per specialized size, see dot_fixed
+#define DEFINE_DIM_KERNELS(D)                                                 \
+  RAG_KERNEL                                                                  \
+  static double dot_##D(const float *a, const float *b, size_t dim) {         \
+    (void)dim;                                                                \
+    return dot_fixed(a, b, D);                                                 \
+  }                                                                           \
+  RAG_KERNEL                                                                  \
+  static float inverse_norm_##D(const float *a, size_t dim) {                 \
+    (void)dim;                                                                \
+    double norm = sqrt(sum_squares_fixed(a, D));                               \
+    return norm == 0.0 ? 0.0f : (float)(1.0 / norm);                          \
+  }                                                                           \
+  RAG_KERNEL                                                                  \
+  static void score_rows_##D(const float *query, float query_inv_norm,        \
+                             const float *rows, const float *row_inv_norms,   \
+                             size_t count, size_t dim, double *scores) {      \
+    (void)dim;                                                                \
+    for (size_t r = 0; r < count; ++r, rows += D) {                           \
+      scores[r] = dot_fixed(query, rows, D) * query_inv_norm * row_inv_norms[r]; \
+    }                                                                         \
+  }                                                                           \
+  static const rag_kernels_t kernels_##D = {D, dot_##D, inverse_norm_##D, score_rows_##D};
+
+RAG_SPECIALIZED_DIMS(DEFINE_DIM_KERNELS)
+
+const rag_kernels_t *rag_kernels_for(size_t dim) {
+#define SELECT_DIM_KERNELS(D) if (dim == D) return &kernels_##D;
+  RAG_SPECIALIZED_DIMS(SELECT_DIM_KERNELS)
+#undef SELECT_DIM_KERNELS
+  return &generic_kernels;
+}
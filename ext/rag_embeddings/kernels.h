@@ -0,0 +1,74 @@
+#ifndef RAG_EMBEDDINGS_KERNELS_H
+#define RAG_EMBEDDINGS_KERNELS_H
+
+#include <stddef.h>   // For size_t
+
+// Numeric kernels of the extension. This file and kernels.c do not depend
+// on Ruby, so the same code is compiled into the extension and into the
+// standalone benchmark (bench/kernels_bench.c, `rake bench:kernels`).
+// Accumulation is done in double to limit rounding errors on long vectors.
+
+// Kernels are built once per x86-64 level when extconf.rb detected support
+// for function multi-versioning; the dynamic loader then binds the best
+// version for the CPU (see RagEmbeddings.build_info)
+#if defined(RAG_TARGET_CLONES_LEVELS)
+#define RAG_KERNEL __attribute__((target_clones("arch=x86-64-v4", "arch=x86-64-v3", "default")))
+#elif defined(RAG_TARGET_CLONES_FEATURES)
+#define RAG_KERNEL __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define RAG_KERNEL
+#endif
+
+// Dot product of two vectors
+double rag_dot(const float *a, const float *b, size_t dim);
+
+// Sum of the squares of the values (squared L2 norm)
+double rag_sum_squares(const float *a, size_t dim);
+
+// Cosine similarity in a single pass, clamped to [-1, 1]; 0 if either vector is zero
+double rag_cosine(const float *a, const float *b, size_t dim);
+
+// 1 / |a| as a float, or 0 for a zero vector
+float rag_inverse_norm(const float *a, size_t dim);
+
+// Scales a to unit length in place and returns its original magnitude
+// (the vector is left untouched when the magnitude is 0)
+double rag_normalize(float *a, size_t dim);
+
+// Cosine similarity of a query against `rows` consecutive rows of a
+// row-major matrix, given the precomputed inverse norms of the query and
+// of every row. Writes one score per row.
+void rag_score_rows(const float *query, float query_inv_norm,
+                    const float *rows, const float *row_inv_norms,
+                    size_t count, size_t dim, double *scores);
+
+// Scores of `query_count` queries against `count` rows, the small matrix
+// product of a batched search: scores[q * count + r] is the cosine of
+// query q and row r. Queries are taken RAG_TILE_QUERIES at a time, so every
+// row loaded from memory is used for that many dot products.
+#define RAG_TILE_QUERIES 4
+
+void rag_score_tile(const float *queries, const float *query_inv_norms, size_t query_count,
+                    const float *rows, const float *row_inv_norms,
+                    size_t count, size_t dim, double *scores);
+
+// Kernels for one vector size, looked up once per store or scan with
+// rag_kernels_for. The function pointers take the same arguments as the
+// generic kernels above; the specialized versions ignore `dim`.
+typedef struct {
+  size_t dim;           // Size the kernels are specialized for, 0 for the generic ones
+  double (*dot)(const float *a, const float *b, size_t dim);
+  float (*inverse_norm)(const float *a, size_t dim);
+  void (*score_rows)(const float *query, float query_inv_norm,
+                     const float *rows, const float *row_inv_norms,
+                     size_t count, size_t dim, double *scores);
+} rag_kernels_t;
+
+// Sizes emitted by common embedding models, with a compile-time trip count
+#define RAG_SPECIALIZED_DIMS(X) X(384) X(768) X(1024) X(1536) X(3072) X(4096)
+
+// Kernels unrolled for `dim` when it is one of RAG_SPECIALIZED_DIMS,
+// the generic kernels otherwise. Never returns NULL.
+const rag_kernels_t *rag_kernels_for(size_t dim);
+
+#endif
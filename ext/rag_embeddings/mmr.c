@@ -0,0 +1,147 @@
+#include <ruby.h>     // Ruby API
+#include <math.h>     // For INFINITY
+#include <stdint.h>   // For integer types like uint32_t
+
+#include "rag_embeddings.h"
+#include "kernels.h"
+
+// Maximal marginal relevance: picks k candidates one at a time, each time
+// the one maximizing
+//   lambda * sim(query, c) - (1 - lambda) * max(sim(c, s) for s already picked)
+// so near-duplicates of a picked candidate fall behind. The candidates are
+// copied into one aligned matrix; sim(query, c) is one batch of score_rows,
+// and after each pick one more batch (the picked row against all rows)
+// updates the max similarity of every candidate to the picked set, so the
+// whole selection costs k + 1 passes over the matrix.
+
+// Dimension of a query given as an Embedding or an Array
+static uint32_t vector_dim(VALUE vector) {
+  if (rb_typeddata_is_kind_of(vector, &embedding_type)) {
+    return ((const embedding_t *)RTYPEDDATA_DATA(vector))->dim;
+  }
+  return rag_check_dim(RARRAY_LEN(rb_convert_type(vector, T_ARRAY, "Array", "to_ary")));
+}
+
+typedef struct {
+  VALUE query;
+  VALUE candidates;
+  long n;               // Candidates
+  long k;               // Candidates to pick
+  double lambda;
+  rag_metric_t metric;  // Similarity for both relevance and diversity
+  uint32_t dim;
+  const rag_kernels_t *kernels;
+  float *matrix;        // n candidate rows then the query, aligned
+  size_t matrix_bytes;
+} mmr_t;
+
+static VALUE mmr_select(VALUE arg) {
+  mmr_t *mmr = (mmr_t *)arg;
+  long n = mmr->n;
+  uint32_t dim = mmr->dim;
+  float *q = mmr->matrix + (size_t)n * dim;
+  rag_read_vector(mmr->query, q, dim);
+  for (long i = 0; i < n; ++i) {
+    rag_read_vector(rb_ary_entry(mmr->candidates, i), mmr->matrix + (size_t)i * dim, dim);
+  }
+
+  VALUE tmp_norms, tmp_scores;
+  float *inv_norms = ALLOCV_N(float, tmp_norms, n ? n : 1);
+  // Similarity to the query, max similarity to the picked set, scratch for one pass
+  double *scores = ALLOCV_N(double, tmp_scores, 3 * (size_t)(n ? n : 1));
+  double *relevance = scores;
+  double *redundancy = scores + n;
+  double *pass = scores + 2 * n;
+  // Unit scales turn the cosine of score_rows into the raw inner product
+  int dot = mmr->metric == RAG_METRIC_DOT;
+  for (long i = 0; i < n; ++i) {
+    inv_norms[i] = dot ? 1.0f : mmr->kernels->inverse_norm(mmr->matrix + (size_t)i * dim, dim);
+    redundancy[i] = -INFINITY;
+  }
+  mmr->kernels->score_rows(q, dot ? 1.0f : mmr->kernels->inverse_norm(q, dim), mmr->matrix, inv_norms, (size_t)n, dim, relevance);
+
+  VALUE result = rb_ary_new_capa(mmr->k);
+  for (long picked = 0; picked < mmr->k; ++picked) {
+    long best = -1;
+    double best_score = -INFINITY;
+    for (long i = 0; i < n; ++i) {
+      if (redundancy[i] == INFINITY) continue;   // Already picked
+      double score = mmr->lambda * relevance[i] - (picked ? (1.0 - mmr->lambda) * redundancy[i] : 0.0);
+      if (best < 0 || score > best_score) {
+        best = i;
+        best_score = score;
+      }
+    }
+
+    rb_ary_push(result, rb_assoc_new(LONG2NUM(best), DBL2NUM(relevance[best])));
+    if (picked + 1 == mmr->k) break;
+
+    // Similarity of the picked row to every row, folded into the maxima
+    const float *row = mmr->matrix + (size_t)best * dim;
+    mmr->kernels->score_rows(row, inv_norms[best], mmr->matrix, inv_norms, (size_t)n, dim, pass);
+    for (long i = 0; i < n; ++i) {
+      if (pass[i] > redundancy[i]) redundancy[i] = pass[i];
+    }
+    redundancy[best] = INFINITY;
+  }
+
+  ALLOCV_END(tmp_norms);
+  ALLOCV_END(tmp_scores);
+  return result;
+}
+
+static VALUE mmr_free(VALUE arg) {
+  mmr_t *mmr = (mmr_t *)arg;
+  rag_aligned_free(mmr->matrix, mmr->matrix_bytes);
+  return Qnil;
+}
+
+// Class method: RagEmbeddings.mmr(query, candidates, k:, lambda: 0.5, metric: :cosine)
+// Query and candidates are Embeddings or Arrays of numbers of the same
+// dimension. Returns [[index, similarity], ...] in selection order, where
+// index is the position in candidates and similarity the one to the query.
+// metric (:cosine or :dot) is used for both the relevance and the
+// diversity terms. lambda = 1 ranks by relevance only, 0 by diversity only.
+static VALUE rag_mmr(int argc, VALUE *argv, VALUE self) {
+  mmr_t mmr;
+  VALUE opts;
+  rb_scan_args(argc, argv, "2:", &mmr.query, &mmr.candidates, &opts);
+  Check_Type(mmr.candidates, T_ARRAY);
+
+  static ID keywords[3];
+  if (!keywords[0]) {
+    keywords[0] = rb_intern("k");
+    keywords[1] = rb_intern("lambda");
+    keywords[2] = rb_intern("metric");
+  }
+  VALUE values[3];
+  rb_get_kwargs(opts, keywords, 1, 2, values);
+  mmr.k = NUM2LONG(values[0]);
+  if (mmr.k < 0) {
+    rb_raise(rb_eArgError, "k must not be negative");
+  }
+  mmr.lambda = values[1] == Qundef ? 0.5 : NUM2DBL(values[1]);
+  if (!(mmr.lambda >= 0.0 && mmr.lambda <= 1.0)) {
+    rb_raise(rb_eArgError, "lambda must be between 0 and 1");
+  }
+
+  mmr.metric = rag_check_metric(values[2] == Qundef ? Qnil : values[2]);
+
+  mmr.dim = vector_dim(mmr.query);
+  mmr.kernels = rag_kernels_for(mmr.dim);
+  mmr.n = RARRAY_LEN(mmr.candidates);
+  if (mmr.k > mmr.n) mmr.k = mmr.n;
+  size_t row_bytes = (size_t)mmr.dim * sizeof(float);
+  if ((size_t)mmr.n >= SIZE_MAX / row_bytes) {
+    rb_raise(rb_eNoMemError, "Too many candidates");
+  }
+  mmr.matrix_bytes = ((size_t)mmr.n + 1) * row_bytes;
+  mmr.matrix = rag_aligned_alloc(mmr.matrix_bytes);
+
+  // The candidates are read into the matrix inside: free it even if one is invalid
+  return rb_ensure(mmr_select, (VALUE)&mmr, mmr_free, (VALUE)&mmr);
+}
+
+void Init_mmr(VALUE mRag) {
+  rb_define_module_function(mRag, "mmr", rag_mmr, -1);
+}
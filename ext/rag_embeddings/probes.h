@@ -0,0 +1,41 @@
+#ifndef RAG_EMBEDDINGS_PROBES_H
+#define RAG_EMBEDDINGS_PROBES_H
+
+// USDT (SystemTap / DTrace compatible) static probes on the hot paths.
+// A probe compiles to a single nop plus a note in the ELF file, so it costs
+// nothing until a tracer attaches to it. extconf.rb defines RAG_USDT when
+// <sys/sdt.h> is available (disable with --disable-usdt); otherwise the
+// macros expand to nothing.
+//
+// Provider: rag_embeddings
+//   search__start(store, rows, dim, k)    VectorStore#search begins its scan
+//   search__done(store, rows, hits)       VectorStore#search returns
+//   store__add(store, id, rows)           a row is appended to a VectorStore
+//   store__map(store, rows, bytes)        a store file is mapped by VectorStore.map
+//   topk__start(dim, k)                   a streaming TopK scan is created
+//   topk__row(id, bytes)                  a packed row (SQLite BLOB) is pushed to a TopK
+//   topk__done(rows, bytes, hits)         TopK#results is read
+//
+//   bpftrace -e 'usdt:./embedding.so:rag_embeddings:search__start { @t[tid] = nsecs }
+//                usdt:./embedding.so:rag_embeddings:search__done /@t[tid]/ {
+//                  @us = hist((nsecs - @t[tid]) / 1000); delete(@t[tid]) }'
+
+#if defined(RAG_USDT) && defined(HAVE_SYS_SDT_H)
+#include <sys/sdt.h>
+
+#define RAG_PROBE2(name, a, b) \
+  DTRACE_PROBE2(rag_embeddings, name, a, b)
+#define RAG_PROBE3(name, a, b, c) \
+  DTRACE_PROBE3(rag_embeddings, name, a, b, c)
+#define RAG_PROBE4(name, a, b, c, d) \
+  DTRACE_PROBE4(rag_embeddings, name, a, b, c, d)
+
+#else
+
+#define RAG_PROBE2(name, a, b) do { } while (0)
+#define RAG_PROBE3(name, a, b, c) do { } while (0)
+#define RAG_PROBE4(name, a, b, c, d) do { } while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef RAG_EMBEDDINGS_H
+#define RAG_EMBEDDINGS_H
+
+#include <ruby.h>     // Ruby API
+#include <stdint.h>   // For integer types like uint32_t
+
+// Alignment of every vector payload: one cache line, and a full AVX-512 register
+#define RAG_ALIGNMENT 64
+
+// Largest dimension accepted for embeddings and stores (the payload of one
+// vector stays below 8 GB and every index fits in 32 bits)
+#define RAG_MAX_DIM ((uint32_t)INT32_MAX)
+
+// Main data structure for storing embeddings.
+// A small header followed, in the same allocation, by the values aligned
+// to RAG_ALIGNMENT bytes (see rag_embedding_new), so the struct stays compact
+// while vectors of any size start on a cache line. Embeddings created in
+// bulk live in an arena instead (see arena.c), which they keep alive.
+typedef struct {
+  uint32_t dim;       // Dimension of the embedding vector
+  float *values;      // The actual values, RAG_ALIGNMENT-byte aligned
+  VALUE arena;        // Arena holding this struct and its values, Qfalse when owned
+} embedding_t;
+// Type information of RagEmbeddings::Embedding, defined in embedding.c.
+// Other translation units use it to wrap or unwrap embedding_t structs.
+// Embeddings from an arena use a child type (arena.c), so checks against
+// embedding_type accept both.
+extern const rb_data_type_t embedding_type;
+
+// Copies `dim` values from an Embedding or an Array of numbers into `out`.
+// Raises ArgumentError on a dimension mismatch and TypeError otherwise.
+void rag_read_vector(VALUE vector, float *out, uint32_t dim);
+
+// Checks a dimension coming from Ruby, raising ArgumentError when it is
+// not between 1 and RAG_MAX_DIM
+uint32_t rag_check_dim(long dim);
+
+// Similarity used to rank rows in VectorStore and TopK: cosine, or the raw
+// inner product (for models trained for it, or vectors already normalized)
+typedef enum {
+  RAG_METRIC_COSINE = 0,
+  RAG_METRIC_DOT = 1
+} rag_metric_t;
+
+// Converts :cosine / :dot (nil means :cosine), raising ArgumentError otherwise
+rag_metric_t rag_check_metric(VALUE metric);
+VALUE rag_metric_sym(rag_metric_t metric);
+
+// Allocates an embedding of `dim` values, zeroed when `zero` is set.
+// Raises NoMemoryError on failure; release with rag_embedding_free.
+embedding_t *rag_embedding_new(uint32_t dim, int zero);
+void rag_embedding_free(embedding_t *emb);
+
+// RAG_ALIGNMENT-byte aligned buffers for vectors and matrices, accounted
+// to the Ruby GC like xmalloc. Raise NoMemoryError on failure.
+void *rag_aligned_alloc(size_t bytes);
+void rag_aligned_free(void *ptr, size_t bytes);
+
+// Entry points of the other translation units of the extension.
+// Each one defines its classes or methods under the RagEmbeddings module.
+void Init_chunker(VALUE mRag);
+void Init_feature_hash(VALUE cEmbedding);
+void Init_arena(VALUE cEmbedding);
+void Init_vector_store(VALUE mRag);
+void Init_bitmap(VALUE mRag);
+void Init_fusion(VALUE mRag);
+void Init_mmr(VALUE mRag);
+void Init_topk(VALUE mRag);
+void Init_histogram(VALUE mRag);
+void Init_build_info(VALUE mRag);
+
+#endif
@@ -0,0 +1,241 @@
+#include <ruby.h>     // Ruby API
+#include <stdint.h>   // For integer types like int64_t
+#include <string.h>   // For memcpy
+#include <time.h>     // For clock_gettime
+
+#include "rag_embeddings.h"
+#include "kernels.h"
+#include "topk.h"
+#include "probes.h"
+
+// Streaming exact top-k: rows are pushed one at a time (typically straight
+// from a SQLite cursor), scored against the query and kept only if they
+// are among the k best, so a scan needs O(k) memory whatever the table size.
+// With timing enabled, the time spent decoding, scoring and updating the
+// heap is accumulated separately for search statistics.
+typedef struct {
+  uint32_t dim;
+  const rag_kernels_t *kernels;   // Specialized for dim when possible
+  float *query;         // Copy of the query vector
+  float query_inv_norm; // 1 with the dot metric
+  rag_metric_t metric;
+  float *row;           // Aligned buffer the packed rows are decoded into
+  int64_t *ids;         // Id of each kept hit, indexed by rag_hit_t.index
+  rag_hit_t *hits;
+  rag_topk_t topk;
+  size_t rows;          // Rows pushed
+  size_t bytes;         // Bytes of packed rows pushed
+  int timing;           // Measure phase times
+  uint64_t decode_ns;
+  uint64_t scoring_ns;
+  uint64_t heap_ns;
+} topk_scan_t;
+
+static void topk_free(void *ptr) {
+  topk_scan_t *scan = (topk_scan_t *)ptr;
+  if (scan) {
+    rag_aligned_free(scan->query, (size_t)scan->dim * sizeof(float));
+    rag_aligned_free(scan->row, (size_t)scan->dim * sizeof(float));
+    xfree(scan->ids);
+    xfree(scan->hits);
+    xfree(scan);
+  }
+}
+
+static size_t topk_memsize(const void *ptr) {
+  const topk_scan_t *scan = (const topk_scan_t *)ptr;
+  if (!scan) return 0;
+  return sizeof(topk_scan_t) + 2 * (size_t)scan->dim * sizeof(float) +
+         scan->topk.k * (sizeof(int64_t) + sizeof(rag_hit_t));
+}
+
+static const rb_data_type_t topk_type = {
+  "RagEmbeddings/TopK",
+  {0, topk_free, topk_memsize,},
+  0, 0,
+  RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+static VALUE topk_alloc(VALUE klass) {
+  topk_scan_t *scan;
+  return TypedData_Make_Struct(klass, topk_scan_t, &topk_type, scan);
+}
+
+static topk_scan_t *get_topk(VALUE self) {
+  topk_scan_t *scan;
+  TypedData_Get_Struct(self, topk_scan_t, &topk_type, scan);
+  if (!scan->query) {
+    rb_raise(rb_eRuntimeError, "TopK not initialized");
+  }
+  return scan;
+}
+
+static inline uint64_t monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Instance method: topk.initialize(query, k, timing = false, metric: :cosine)
+// The query is an Embedding or an Array of numbers; metric is :cosine or :dot
+static VALUE topk_initialize(int argc, VALUE *argv, VALUE self) {
+  topk_scan_t *scan;
+  TypedData_Get_Struct(self, topk_scan_t, &topk_type, scan);
+  if (scan->query) {
+    rb_raise(rb_eRuntimeError, "TopK already initialized");
+  }
+
+  VALUE query, rb_k, rb_timing, opts, rb_metric = Qnil;
+  rb_scan_args(argc, argv, "21:", &query, &rb_k, &rb_timing, &opts);
+  if (!NIL_P(opts)) {
+    static ID keywords[1];
+    if (!keywords[0]) keywords[0] = rb_intern("metric");
+    rb_get_kwargs(opts, keywords, 0, 1, &rb_metric);
+    if (rb_metric == Qundef) rb_metric = Qnil;
+  }
+  rag_metric_t metric = rag_check_metric(rb_metric);
+
+  long k = NUM2LONG(rb_k);
+  if (k < 0) {
+    rb_raise(rb_eArgError, "k must not be negative");
+  }
+
+  uint32_t dim = rb_typeddata_is_kind_of(query, &embedding_type)
+                   ? ((const embedding_t *)RTYPEDDATA_DATA(query))->dim
+                   : rag_check_dim(RARRAY_LEN(rb_convert_type(query, T_ARRAY, "Array", "to_ary")));
+
+  float *values = rag_aligned_alloc((size_t)dim * sizeof(float));
+  scan->query = values;
+  scan->dim = dim;
+  scan->kernels = rag_kernels_for(scan->dim);
+  rag_read_vector(query, values, scan->dim);
+  scan->metric = metric;
+  scan->query_inv_norm = metric == RAG_METRIC_DOT ? 1.0f : scan->kernels->inverse_norm(values, scan->dim);
+  scan->row = rag_aligned_alloc((size_t)dim * sizeof(float));
+  scan->ids = xmalloc((k ? k : 1) * sizeof(int64_t));
+  scan->hits = xmalloc((k ? k : 1) * sizeof(rag_hit_t));
+  rag_topk_init(&scan->topk, scan->hits, (size_t)k);
+  scan->timing = RTEST(rb_timing);
+  RAG_PROBE2(topk__start, dim, k);
+  return self;
+}
+
+// Scores the decoded row and offers it to the heap
+static void topk_offer(topk_scan_t *scan, int64_t id) {
+  uint64_t t0 = scan->timing ? monotonic_ns() : 0;
+  double score = scan->kernels->dot(scan->query, scan->row, scan->dim);
+  if (scan->metric == RAG_METRIC_COSINE) {
+    score *= scan->query_inv_norm * scan->kernels->inverse_norm(scan->row, scan->dim);
+  }
+  uint64_t t1 = scan->timing ? monotonic_ns() : 0;
+
+  // Ids live in a side array indexed by heap slot: a replaced hit reuses the
+  // slot of the evicted root, so the index stored in the heap is the slot
+  size_t before = scan->topk.size;
+  if (before < scan->topk.k) {
+    scan->ids[before] = id;
+    rag_topk_push(&scan->topk, score, before);
+  } else if (scan->topk.k > 0 && score > scan->topk.hits[0].score) {
+    scan->ids[scan->topk.hits[0].index] = id;
+    rag_topk_push(&scan->topk, score, scan->topk.hits[0].index);
+  }
+  scan->rows++;
+
+  if (scan->timing) {
+    scan->scoring_ns += t1 - t0;
+    scan->heap_ns += monotonic_ns() - t1;
+  }
+}
+
+// Instance method: topk.push(id, vector)
+static VALUE topk_push(VALUE self, VALUE rb_id, VALUE vector) {
+  topk_scan_t *scan = get_topk(self);
+  int64_t id = NUM2LL(rb_id);
+
+  uint64_t t0 = scan->timing ? monotonic_ns() : 0;
+  rag_read_vector(vector, scan->row, scan->dim);
+  if (scan->timing) scan->decode_ns += monotonic_ns() - t0;
+
+  topk_offer(scan, id);
+  return self;
+}
+
+// Instance method: topk.push_packed(id, blob)
+// Pushes a row stored as native float32 bytes (the Database BLOB format)
+static VALUE topk_push_packed(VALUE self, VALUE rb_id, VALUE blob) {
+  topk_scan_t *scan = get_topk(self);
+  int64_t id = NUM2LL(rb_id);
+  StringValue(blob);
+
+  if ((size_t)RSTRING_LEN(blob) != (size_t)scan->dim * sizeof(float)) {
+    rb_raise(rb_eArgError, "Dimension mismatch: %ld vs %u",
+             RSTRING_LEN(blob) / (long)sizeof(float), scan->dim);
+  }
+
+  // The copy aligns the row for the kernel; it is the whole decoding cost
+  uint64_t t0 = scan->timing ? monotonic_ns() : 0;
+  memcpy(scan->row, RSTRING_PTR(blob), (size_t)scan->dim * sizeof(float));
+  if (scan->timing) scan->decode_ns += monotonic_ns() - t0;
+
+  scan->bytes += (size_t)RSTRING_LEN(blob);
+  RAG_PROBE2(topk__row, id, RSTRING_LEN(blob));
+  topk_offer(scan, id);
+  return self;
+}
+
+// Instance method: topk.results
+// Returns [[id, similarity], ...] by decreasing similarity
+static VALUE topk_results(VALUE self) {
+  topk_scan_t *scan = get_topk(self);
+
+  // Sort a copy so that more rows can still be pushed afterwards
+  size_t size = scan->topk.size;
+  VALUE tmp;
+  rag_hit_t *sorted = ALLOCV_N(rag_hit_t, tmp, size ? size : 1);
+  memcpy(sorted, scan->topk.hits, size * sizeof(rag_hit_t));
+  rag_topk_t copy;
+  rag_topk_init(&copy, sorted, scan->topk.k);
+  copy.size = size;
+
+  uint64_t t0 = scan->timing ? monotonic_ns() : 0;
+  rag_topk_sort(&copy);
+  if (scan->timing) scan->heap_ns += monotonic_ns() - t0;
+
+  RAG_PROBE3(topk__done, scan->rows, scan->bytes, size);
+
+  VALUE result = rb_ary_new_capa((long)size);
+  for (size_t i = 0; i < size; ++i) {
+    double score = sorted[i].score;
+    if (scan->metric == RAG_METRIC_COSINE) {
+      if (score > 1.0) score = 1.0;
+      if (score < -1.0) score = -1.0;
+    }
+    rb_ary_push(result, rb_assoc_new(LL2NUM(scan->ids[sorted[i].index]), DBL2NUM(score)));
+  }
+  ALLOCV_END(tmp);
+  return result;
+}
+
+// Instance method: topk.stats
+// Returns { rows_scanned:, bytes:, decode_time:, scoring_time:, heap_time: } (times in seconds)
+static VALUE topk_stats(VALUE self) {
+  topk_scan_t *scan = get_topk(self);
+  VALUE stats = rb_hash_new();
+  rb_hash_aset(stats, ID2SYM(rb_intern("rows_scanned")), SIZET2NUM(scan->rows));
+  rb_hash_aset(stats, ID2SYM(rb_intern("bytes")), SIZET2NUM(scan->bytes));
+  rb_hash_aset(stats, ID2SYM(rb_intern("decode_time")), DBL2NUM(scan->decode_ns / 1e9));
+  rb_hash_aset(stats, ID2SYM(rb_intern("scoring_time")), DBL2NUM(scan->scoring_ns / 1e9));
+  rb_hash_aset(stats, ID2SYM(rb_intern("heap_time")), DBL2NUM(scan->heap_ns / 1e9));
+  return stats;
+}
+
+void Init_topk(VALUE mRag) {
+  VALUE cTopK = rb_define_class_under(mRag, "TopK", rb_cObject);
+  rb_define_alloc_func(cTopK, topk_alloc);
+
+  rb_define_method(cTopK, "initialize", topk_initialize, -1);
+  rb_define_method(cTopK, "push", topk_push, 2);
+  rb_define_method(cTopK, "push_packed", topk_push_packed, 2);
+  rb_define_method(cTopK, "results", topk_results, 0);
+  rb_define_method(cTopK, "stats", topk_stats, 0);
+}
@@ -0,0 +1,72 @@
+#ifndef RAG_EMBEDDINGS_TOPK_H
+#define RAG_EMBEDDINGS_TOPK_H
+
+#include <stddef.h>   // For size_t
+
+// Bounded min-heap keeping the k best scores seen during a scan.
+// The root is the worst kept hit, so a new score only has to beat it.
+typedef struct {
+  double score;
+  size_t index;       // Row of the hit in the scanned matrix
+} rag_hit_t;
+
+typedef struct {
+  rag_hit_t *hits;    // Caller-provided storage for k hits
+  size_t size;
+  size_t k;
+} rag_topk_t;
+
+static inline void rag_topk_init(rag_topk_t *topk, rag_hit_t *storage, size_t k) {
+  topk->hits = storage;
+  topk->size = 0;
+  topk->k = k;
+}
+
+static inline void rag_topk_sift_down(rag_hit_t *hits, size_t size, size_t i) {
+  for (;;) {
+    size_t smallest = i;
+    size_t left = 2 * i + 1;
+    size_t right = left + 1;
+    if (left < size && hits[left].score < hits[smallest].score) smallest = left;
+    if (right < size && hits[right].score < hits[smallest].score) smallest = right;
+    if (smallest == i) return;
+    rag_hit_t tmp = hits[i];
+    hits[i] = hits[smallest];
+    hits[smallest] = tmp;
+    i = smallest;
+  }
+}
+
+// Offers a hit to the heap, keeping it only if it is among the k best so far
+static inline void rag_topk_push(rag_topk_t *topk, double score, size_t index) {
+  if (topk->size < topk->k) {
+    size_t i = topk->size++;
+    topk->hits[i].score = score;
+    topk->hits[i].index = index;
+    while (i > 0) {
+      size_t parent = (i - 1) / 2;
+      if (topk->hits[parent].score <= topk->hits[i].score) break;
+      rag_hit_t tmp = topk->hits[i];
+      topk->hits[i] = topk->hits[parent];
+      topk->hits[parent] = tmp;
+      i = parent;
+    }
+  } else if (topk->k > 0 && score > topk->hits[0].score) {
+    topk->hits[0].score = score;
+    topk->hits[0].index = index;
+    rag_topk_sift_down(topk->hits, topk->size, 0);
+  }
+}
+
+// Sorts the kept hits by descending score (destroys the heap order)
+static inline void rag_topk_sort(rag_topk_t *topk) {
+  // Heap sort: repeatedly move the worst hit to the end
+  for (size_t end = topk->size; end > 1; --end) {
+    rag_hit_t tmp = topk->hits[0];
+    topk->hits[0] = topk->hits[end - 1];
+    topk->hits[end - 1] = tmp;
+    rag_topk_sift_down(topk->hits, end - 1, 0);
+  }
+}
+
+#endif
@@ -0,0 +1,1188 @@
+#include <ruby.h>     // Ruby API
+#include <ruby/thread.h> // For rb_thread_call_without_gvl
+#include <errno.h>    // For errno
+#include <math.h>     // For sqrt and isnan
+#include <stdint.h>   // For integer types like int64_t
+#include <stdio.h>    // For the store files
+#include <string.h>   // For memcpy
+#include <time.h>     // For clock_gettime
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h> // For mmap
+#include <sys/stat.h> // For fstat
+#include <fcntl.h>    // For open
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>   // For close, fsync and getpid
+#endif
+
+#include "rag_embeddings.h"
+#include "kernels.h"
+#include "topk.h"
+#include "bitmap.h"
+#include "probes.h"
+
+// In-memory matrix of embeddings, one row per id, searched by brute force.
+// Rows are stored contiguously so a scan streams through memory, and the
+// inverse norm of every row is computed once at insert time, so scoring a
+// row against a query costs a single dot product.
+//
+// Searches run without the GVL, concurrently with writers, in RCU style:
+// a search takes a snapshot (the current rows block and the row count),
+// pins the block and only reads those rows. Appending writes past the end
+// of every snapshot, so it happens in place; anything that would move or
+// overwrite visible rows (growing, deleting) builds a new block and swaps
+// the store pointer to it. A replaced block is retired and freed when its
+// last reader leaves. Readers and writers only touch the pin counts while
+// holding the GVL, so no atomics are needed.
+typedef struct {
+  size_t capacity;      // Allocated rows
+  int64_t *ids;         // Id of each row (the SQLite rowid for a Database)
+  float *vectors;       // capacity * dim values, row-major, RAG_ALIGNMENT-byte aligned
+  float *inv_norms;     // 1 / |row| (0 for zero rows), or 1 with the dot metric
+  void *mapping;        // File mapping the rows point into (VectorStore.map), or NULL
+  size_t mapping_bytes;
+  size_t readers;       // Searches running on this block without the GVL
+  int retired;          // Replaced in its store: freed by the last reader
+} rows_block_t;
+
+// Id -> row lookup for deletes, an open-addressing hash table with linear
+// probing. Built on the first delete, then kept up to date by adds and
+// deletes, so a store that never deletes does not pay for it.
+typedef struct {
+  int64_t id;
+  size_t row;           // ROW_NONE for an empty slot
+} id_slot_t;
+
+#define ROW_NONE SIZE_MAX
+
+typedef struct {
+  id_slot_t *slots;     // capacity slots, or NULL until built
+  size_t capacity;      // Power of two, at least twice count
+  size_t count;
+  int duplicates;       // Some id was added twice: the lookup only knows one of its rows
+} id_lookup_t;
+
+typedef struct {
+  uint32_t dim;         // Dimension of every row
+  rag_metric_t metric;  // Ranking similarity
+  const rag_kernels_t *kernels;   // Kernels for dim, chosen once at initialize
+  size_t size;          // Number of rows
+  rows_block_t *rows;   // Current rows, NULL until the first add
+  id_lookup_t lookup;
+} vector_store_t;
+
+// File written by VectorStore#save and mapped as is by VectorStore.map:
+// this header, then the ids, the inverse norms and the row-major vectors,
+// each section starting on a RAG_ALIGNMENT boundary. Values are in native
+// byte order; `endian` tells a file from another architecture apart.
+#define STORE_FILE_MAGIC "RAGVSTOR"
+#define STORE_FILE_VERSION 1
+#define STORE_FILE_ENDIAN 0x01020304u
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t endian;
+  uint32_t dim;
+  uint32_t metric;      // rag_metric_t
+  uint64_t rows;
+  uint64_t ids_offset;
+  uint64_t inv_norms_offset;
+  uint64_t vectors_offset;
+  uint64_t bytes;       // Size of the whole file
+} store_file_header_t;
+
+// The header fills exactly one RAG_ALIGNMENT block
+typedef char store_file_header_size_check[sizeof(store_file_header_t) == RAG_ALIGNMENT ? 1 : -1];
+
+// Rows scored per call to the batch kernel during a scan
+#define SCAN_BLOCK 256
+
+// Scans of fewer values than this keep the GVL: releasing it costs more
+#define SCAN_WITHOUT_GVL_VALUES (1 << 16)
+
+// Batched searches score the rows tile by tile: a tile of about this many
+// bytes stays in cache while a block of up to BATCH_QUERY_BLOCK queries is
+// scored against it, so the store is streamed from memory once per block of
+// queries instead of once per query
+#define BATCH_TILE_BYTES (128 * 1024)
+#define BATCH_TILE_MAX_ROWS 1024
+#define BATCH_QUERY_BLOCK 64
+
+// Process-wide totals over the live stores, reported by VectorStore.memory_stats
+static size_t live_stores = 0;
+static size_t live_rows = 0;
+static size_t live_bytes = 0;
+static size_t live_mapped_bytes = 0;
+
+static inline size_t row_bytes(uint32_t dim) {
+  return sizeof(int64_t) + sizeof(float) + (size_t)dim * sizeof(float);
+}
+
+static rows_block_t *rows_block_new(uint32_t dim, size_t capacity) {
+  size_t row_size = (size_t)dim * sizeof(float);
+  if (capacity > SIZE_MAX / row_bytes(dim)) {
+    rb_raise(rb_eNoMemError, "VectorStore too large");
+  }
+  rows_block_t *rows = ZALLOC(rows_block_t);
+  rows->capacity = capacity;
+  rows->ids = xmalloc2(capacity, sizeof(int64_t));
+  rows->inv_norms = xmalloc2(capacity, sizeof(float));
+  rows->vectors = rag_aligned_alloc(capacity * row_size);
+  live_bytes += capacity * row_bytes(dim);
+  return rows;
+}
+
+static void rows_block_free(rows_block_t *rows, uint32_t dim) {
+  if (!rows) return;
+  if (rows->mapping) {
+#ifdef HAVE_SYS_MMAN_H
+    munmap(rows->mapping, rows->mapping_bytes);
+#endif
+    live_mapped_bytes -= rows->mapping_bytes;
+  } else {
+    live_bytes -= rows->capacity * row_bytes(dim);
+    xfree(rows->ids);
+    xfree(rows->inv_norms);
+    rag_aligned_free(rows->vectors, rows->capacity * (size_t)dim * sizeof(float));
+  }
+  xfree(rows);
+}
+
+// Makes `rows` the current block of the store, retiring the previous one
+static void replace_rows(vector_store_t *store, rows_block_t *rows) {
+  rows_block_t *previous = store->rows;
+  store->rows = rows;
+  if (!previous) return;
+  if (previous->readers) {
+    previous->retired = 1;
+  } else {
+    rows_block_free(previous, store->dim);
+  }
+}
+
+// A search leaves a block: the last reader of a retired block frees it
+static void release_rows(rows_block_t *rows, uint32_t dim) {
+  if (--rows->readers == 0 && rows->retired) rows_block_free(rows, dim);
+}
+
+// Copies the first `count` rows of `from` to `to` starting at row `at`
+static void copy_rows(rows_block_t *to, size_t at, const rows_block_t *from, size_t first, size_t count, uint32_t dim) {
+  if (!count) return;
+  memcpy(to->ids + at, from->ids + first, count * sizeof(int64_t));
+  memcpy(to->inv_norms + at, from->inv_norms + first, count * sizeof(float));
+  memcpy(to->vectors + at * (size_t)dim, from->vectors + first * (size_t)dim, count * (size_t)dim * sizeof(float));
+}
+
+static inline size_t id_hash(int64_t id, size_t capacity) {
+  uint64_t x = (uint64_t)id * 0x9E3779B97F4A7C15ULL;   // Fibonacci hashing
+  return (size_t)(x ^ (x >> 32)) & (capacity - 1);
+}
+
+// Slot holding id, or the empty slot where it would go
+static size_t lookup_slot(const id_lookup_t *lookup, int64_t id) {
+  size_t i = id_hash(id, lookup->capacity);
+  while (lookup->slots[i].row != ROW_NONE && lookup->slots[i].id != id) {
+    i = (i + 1) & (lookup->capacity - 1);
+  }
+  return i;
+}
+
+static void lookup_resize(id_lookup_t *lookup, size_t capacity) {
+  id_slot_t *old = lookup->slots;
+  size_t old_capacity = lookup->capacity;
+  lookup->slots = ALLOC_N(id_slot_t, capacity);
+  lookup->capacity = capacity;
+  for (size_t i = 0; i < capacity; ++i) lookup->slots[i].row = ROW_NONE;
+  for (size_t i = 0; i < old_capacity; ++i) {
+    if (old[i].row != ROW_NONE) lookup->slots[lookup_slot(lookup, old[i].id)] = old[i];
+  }
+  xfree(old);
+}
+
+static void lookup_put(id_lookup_t *lookup, int64_t id, size_t row) {
+  if (2 * (lookup->count + 1) > lookup->capacity) lookup_resize(lookup, lookup->capacity * 2);
+  size_t i = lookup_slot(lookup, id);
+  if (lookup->slots[i].row != ROW_NONE) {
+    lookup->duplicates = 1;   // Keep the first row, as a scan in row order would
+    return;
+  }
+  lookup->slots[i].id = id;
+  lookup->slots[i].row = row;
+  lookup->count++;
+}
+
+// Empties slot i, shifting back the entries of its probe run (no tombstones)
+static void lookup_remove(id_lookup_t *lookup, size_t i) {
+  size_t mask = lookup->capacity - 1;
+  size_t j = i;
+  for (;;) {
+    j = (j + 1) & mask;
+    if (lookup->slots[j].row == ROW_NONE) break;
+    size_t home = id_hash(lookup->slots[j].id, lookup->capacity);
+    // Move j back into the hole unless its home lies cyclically in (i, j]
+    if (i <= j ? (home <= i || home > j) : (home <= i && home > j)) {
+      lookup->slots[i] = lookup->slots[j];
+      i = j;
+    }
+  }
+  lookup->slots[i].row = ROW_NONE;
+  lookup->count--;
+}
+
+static void lookup_free(id_lookup_t *lookup) {
+  xfree(lookup->slots);
+  memset(lookup, 0, sizeof(*lookup));
+}
+
+static void lookup_build(vector_store_t *store) {
+  size_t capacity = 16;
+  while (capacity < 2 * store->size) capacity *= 2;
+  lookup_resize(&store->lookup, capacity);
+  for (size_t row = 0; row < store->size; ++row) {
+    lookup_put(&store->lookup, store->rows->ids[row], row);
+  }
+}
+
+static void vector_store_free(void *ptr) {
+  vector_store_t *store = (vector_store_t *)ptr;
+  if (store) {
+    live_stores--;
+    live_rows -= store->size;
+    // No search can be running: it would keep the store object alive
+    rows_block_free(store->rows, store->dim);
+    lookup_free(&store->lookup);
+    xfree(store);
+  }
+}
+
+static size_t vector_store_memsize(const void *ptr) {
+  const vector_store_t *store = (const vector_store_t *)ptr;
+  if (!store) return 0;
+  size_t bytes = sizeof(vector_store_t) + store->lookup.capacity * sizeof(id_slot_t);
+  // A mapping lives in the page cache, shared with the other processes
+  if (!store->rows || store->rows->mapping) return bytes;
+  return bytes + sizeof(rows_block_t) + store->rows->capacity * row_bytes(store->dim);
+}
+
+static const rb_data_type_t vector_store_type = {
+  "RagEmbeddings/VectorStore",
+  {0, vector_store_free, vector_store_memsize,},
+  0, 0,
+  RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+static VALUE vector_store_alloc(VALUE klass) {
+  vector_store_t *store;
+  VALUE obj = TypedData_Make_Struct(klass, vector_store_t, &vector_store_type, store);
+  store->kernels = rag_kernels_for(0);
+  live_stores++;
+  return obj;
+}
+
+static vector_store_t *get_vector_store(VALUE self) {
+  vector_store_t *store;
+  TypedData_Get_Struct(self, vector_store_t, &vector_store_type, store);
+  return store;
+}
+
+// The store of a method that reads or writes rows: dim sizes every buffer
+// and tile, so a VectorStore.allocate never initialized must not get there
+static vector_store_t *get_initialized_store(VALUE self) {
+  vector_store_t *store = get_vector_store(self);
+  if (!store->dim) {
+    rb_raise(rb_eRuntimeError, "VectorStore not initialized");
+  }
+  return store;
+}
+
+// Scale applied to the dot products of a row (or of the query): the inverse
+// norm for cosine, 1 for the raw inner product
+static inline float norm_scale(const vector_store_t *store, const float *values) {
+  return store->metric == RAG_METRIC_DOT ? 1.0f : store->kernels->inverse_norm(values, store->dim);
+}
+
+// Makes room for one more row and returns where its values go. The row
+// only becomes visible to searches when the caller increments size.
+static float *append_row(vector_store_t *store, int64_t id) {
+  rows_block_t *rows = store->rows;
+  if (!rows || store->size == rows->capacity) {
+    // Grow into a new block: running searches keep reading the old one
+    rows_block_t *grown = rows_block_new(store->dim, rows ? rows->capacity * 2 : 64);
+    if (rows) copy_rows(grown, 0, rows, 0, store->size, store->dim);
+    replace_rows(store, grown);
+    rows = grown;
+  }
+  rows->ids[store->size] = id;
+  if (store->lookup.slots) lookup_put(&store->lookup, id, store->size);
+  live_rows++;
+  RAG_PROBE3(store__add, (uintptr_t)store, id, store->size + 1);
+  return rows->vectors + store->size * (size_t)store->dim;
+}
+
+// Instance method: store.initialize(dim, metric: :cosine)
+// metric is :cosine or :dot (raw inner product)
+static VALUE vector_store_initialize(int argc, VALUE *argv, VALUE self) {
+  vector_store_t *store = get_vector_store(self);
+  if (store->dim) {
+    rb_raise(rb_eRuntimeError, "VectorStore already initialized");
+  }
+  VALUE rb_dim, opts, rb_metric = Qnil;
+  rb_scan_args(argc, argv, "1:", &rb_dim, &opts);
+  if (!NIL_P(opts)) {
+    static ID keywords[1];
+    if (!keywords[0]) keywords[0] = rb_intern("metric");
+    rb_get_kwargs(opts, keywords, 0, 1, &rb_metric);
+    if (rb_metric == Qundef) rb_metric = Qnil;
+  }
+  store->metric = rag_check_metric(rb_metric);
+  store->dim = rag_check_dim(NUM2LONG(rb_dim));
+  store->kernels = rag_kernels_for(store->dim);
+  return self;
+}
+
+// Instance method: store.add(id, vector)
+// Appends a row; the vector is an Embedding or an Array of numbers
+static VALUE vector_store_add(VALUE self, VALUE rb_id, VALUE vector) {
+  rb_check_frozen(self);
+  vector_store_t *store = get_initialized_store(self);
+  int64_t id = NUM2LL(rb_id);
+
+  // Read into a temporary buffer first, so a bad vector leaves the store untouched
+  VALUE tmp;
+  float *values = ALLOCV_N(float, tmp, store->dim);
+  rag_read_vector(vector, values, store->dim);
+
+  float *row = append_row(store, id);
+  memcpy(row, values, (size_t)store->dim * sizeof(float));
+  store->rows->inv_norms[store->size] = norm_scale(store, row);
+  store->size++;
+
+  ALLOCV_END(tmp);
+  return self;
+}
+
+// Instance method: store.add_packed(id, blob)
+// Appends a row from native-endian float32 bytes, the format of
+// Array#pack("f*") used by Database, without creating Ruby Floats
+static VALUE vector_store_add_packed(VALUE self, VALUE rb_id, VALUE blob) {
+  rb_check_frozen(self);
+  vector_store_t *store = get_initialized_store(self);
+  int64_t id = NUM2LL(rb_id);
+  StringValue(blob);
+
+  if ((size_t)RSTRING_LEN(blob) != (size_t)store->dim * sizeof(float)) {
+    rb_raise(rb_eArgError, "Packed vector has %ld bytes, expected %lu",
+             RSTRING_LEN(blob), (unsigned long)((size_t)store->dim * sizeof(float)));
+  }
+
+  float *row = append_row(store, id);
+  memcpy(row, RSTRING_PTR(blob), (size_t)store->dim * sizeof(float));
+  store->rows->inv_norms[store->size] = norm_scale(store, row);
+  store->size++;
+  return self;
+}
+
+// Removes the row found at lookup slot `slot`: the last row moves into its
+// place, so a delete moves one row instead of every row after it
+static void delete_row(vector_store_t *store, size_t slot) {
+  id_lookup_t *lookup = &store->lookup;
+  size_t index = lookup->slots[slot].row;
+  size_t last = store->size - 1;
+  lookup_remove(lookup, slot);
+
+  rows_block_t *rows = store->rows;
+  if (rows->readers) {
+    // Searches read these rows: overwrite a copy of them instead
+    rows_block_t *copy = rows_block_new(store->dim, rows->capacity);
+    copy_rows(copy, 0, rows, 0, store->size, store->dim);
+    replace_rows(store, copy);
+    rows = copy;
+  }
+  if (index != last) {
+    copy_rows(rows, index, rows, last, 1, store->dim);
+    size_t moved = lookup_slot(lookup, rows->ids[index]);
+    if (lookup->slots[moved].row == last) lookup->slots[moved].row = index;
+  }
+  store->size--;
+  live_rows--;
+  // Another row of the same id may remain, unknown to the lookup: rebuild it next time
+  if (lookup->duplicates) lookup_free(lookup);
+}
+
+// Instance method: store.delete(id)
+// Removes the row with the given id; returns true if there was one. The id
+// is found through a hash table (built on the first delete) and the last
+// row moves into the freed slot, so a delete costs one row. While searches
+// are reading the rows, though, the whole block is copied first: to delete
+// many rows then, use delete_many.
+static VALUE vector_store_delete(VALUE self, VALUE rb_id) {
+  rb_check_frozen(self);
+  vector_store_t *store = get_vector_store(self);
+  int64_t id = NUM2LL(rb_id);
+  if (!store->size) return Qfalse;
+  if (!store->lookup.slots) lookup_build(store);
+
+  size_t slot = lookup_slot(&store->lookup, id);
+  if (store->lookup.slots[slot].row == ROW_NONE) return Qfalse;
+  delete_row(store, slot);
+  return Qtrue;
+}
+
+// Instance method: store.delete_many(ids)
+// Removes the rows with the given ids; returns the number removed. With
+// searches reading the rows, the remaining ones are copied to a new block
+// once for the whole call, in their order; otherwise every row is deleted
+// as by delete.
+static VALUE vector_store_delete_many(VALUE self, VALUE ids) {
+  rb_check_frozen(self);
+  vector_store_t *store = get_vector_store(self);
+  Check_Type(ids, T_ARRAY);
+
+  // Convert every id first, so a bad one leaves the store untouched
+  long count = RARRAY_LEN(ids);
+  VALUE tmp_ids, tmp_marks;
+  int64_t *values = ALLOCV_N(int64_t, tmp_ids, count ? count : 1);
+  for (long i = 0; i < count && i < RARRAY_LEN(ids); ++i) {
+    values[i] = NUM2LL(RARRAY_AREF(ids, i));
+  }
+  if (count > RARRAY_LEN(ids)) count = RARRAY_LEN(ids);   // Shrunk by a conversion
+  if (!store->size || !count) {
+    ALLOCV_END(tmp_ids);
+    return INT2FIX(0);
+  }
+  if (!store->lookup.slots) lookup_build(store);
+
+  size_t deleted = 0;
+  rows_block_t *rows = store->rows;
+  if (!rows->readers) {
+    for (long i = 0; i < count; ++i) {
+      if (!store->lookup.slots) lookup_build(store);
+      size_t slot = lookup_slot(&store->lookup, values[i]);
+      if (store->lookup.slots[slot].row == ROW_NONE) continue;
+      delete_row(store, slot);
+      deleted++;
+    }
+  } else {
+    unsigned char *marks = ALLOCV_N(unsigned char, tmp_marks, store->size);
+    memset(marks, 0, store->size);
+    for (long i = 0; i < count; ++i) {
+      size_t slot = lookup_slot(&store->lookup, values[i]);
+      if (store->lookup.slots[slot].row == ROW_NONE) continue;
+      marks[store->lookup.slots[slot].row] = 1;
+      lookup_remove(&store->lookup, slot);
+      deleted++;
+    }
+    if (deleted) {
+      // One copy of the kept rows, run by run
+      rows_block_t *copy = rows_block_new(store->dim, rows->capacity);
+      size_t kept = 0;
+      for (size_t row = 0; row < store->size;) {
+        size_t end = row;
+        while (end < store->size && !marks[end]) end++;
+        copy_rows(copy, kept, rows, row, end - row, store->dim);
+        kept += end - row;
+        row = end + 1;
+      }
+      replace_rows(store, copy);
+      store->size = kept;
+      live_rows -= deleted;
+      lookup_free(&store->lookup);   // Rows moved: rebuilt on the next delete
+    }
+    ALLOCV_END(tmp_marks);
+  }
+  ALLOCV_END(tmp_ids);
+  return SIZET2NUM(deleted);
+}
+
+static inline uint64_t monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Everything a scan needs, so it can run without the GVL
+typedef struct {
+  const vector_store_t *store;
+  const rows_block_t *rows;   // Snapshot: the block and its first `size` rows
+  size_t size;
+  const float *q;
+  float q_inv_norm;
+  rag_topk_t *topk;
+  const rag_bitmap_t *filter;   // Only rows whose id is in the set are scored, or NULL
+  size_t scored;
+  int timing;
+  uint64_t scoring_ns;
+  uint64_t heap_ns;
+} scan_t;
+
+// Filtered scan: the ids are checked against the set before any scoring,
+// and the rows that pass are scored one by one
+static void scan_filtered_rows(scan_t *scan) {
+  const vector_store_t *store = scan->store;
+  const rows_block_t *rows = scan->rows;
+  rag_bitmap_cursor_t cursor;
+  rag_bitmap_cursor_init(&cursor, scan->filter);
+  size_t matches[SCAN_BLOCK];
+  double scores[SCAN_BLOCK];
+
+  for (size_t start = 0; start < scan->size; start += SCAN_BLOCK) {
+    size_t end = scan->size - start < SCAN_BLOCK ? scan->size : start + SCAN_BLOCK;
+    uint64_t t0 = scan->timing ? monotonic_ns() : 0;
+    size_t count = 0;
+    for (size_t row = start; row < end; ++row) {
+      if (rag_bitmap_cursor_contains(&cursor, rows->ids[row])) matches[count++] = row;
+    }
+    for (size_t i = 0; i < count; ++i) {
+      scores[i] = store->kernels->dot(scan->q, rows->vectors + matches[i] * (size_t)store->dim, store->dim) *
+                  scan->q_inv_norm * rows->inv_norms[matches[i]];
+    }
+    uint64_t t1 = scan->timing ? monotonic_ns() : 0;
+    for (size_t i = 0; i < count; ++i) {
+      rag_topk_push(scan->topk, scores[i], matches[i]);
+    }
+    scan->scored += count;
+    if (scan->timing) {
+      scan->scoring_ns += t1 - t0;
+      scan->heap_ns += monotonic_ns() - t1;
+    }
+  }
+}
+
+// Scores a block of rows at a time, then feeds the block to the heap
+static void scan_all_rows(scan_t *scan) {
+  const vector_store_t *store = scan->store;
+  double scores[SCAN_BLOCK];
+  for (size_t start = 0; start < scan->size; start += SCAN_BLOCK) {
+    size_t count = scan->size - start < SCAN_BLOCK ? scan->size - start : SCAN_BLOCK;
+    uint64_t t0 = scan->timing ? monotonic_ns() : 0;
+    store->kernels->score_rows(scan->q, scan->q_inv_norm, scan->rows->vectors + start * (size_t)store->dim,
+                               scan->rows->inv_norms + start, count, store->dim, scores);
+    uint64_t t1 = scan->timing ? monotonic_ns() : 0;
+    for (size_t i = 0; i < count; ++i) {
+      rag_topk_push(scan->topk, scores[i], start + i);
+    }
+    if (scan->timing) {
+      scan->scoring_ns += t1 - t0;
+      scan->heap_ns += monotonic_ns() - t1;
+    }
+  }
+  scan->scored = scan->size;
+}
+
+static void *scan_rows(void *ptr) {
+  scan_t *scan = (scan_t *)ptr;
+  if (scan->filter) {
+    scan_filtered_rows(scan);
+  } else {
+    scan_all_rows(scan);
+  }
+  uint64_t t0 = scan->timing ? monotonic_ns() : 0;
+  rag_topk_sort(scan->topk);
+  if (scan->timing) scan->heap_ns += monotonic_ns() - t0;
+  return NULL;
+}
+
+// Similarity reported for a hit: cosines are clamped to [-1, 1] against rounding
+static inline double result_score(const vector_store_t *store, double score) {
+  if (store->metric == RAG_METRIC_COSINE) {
+    if (score > 1.0) score = 1.0;
+    if (score < -1.0) score = -1.0;
+  }
+  return score;
+}
+
+// Instance method: store.search(query, k = 10, stats = nil, filter: nil)
+// Exact cosine top-k: returns [[id, similarity], ...] by decreasing similarity.
+// When a Hash is given as stats, it receives :rows_scanned (rows scored),
+// :scoring_time and :heap_time (seconds) for the search. With a
+// RagEmbeddings::Bitmap as filter, only the rows whose id is in it are
+// scored, so the k results all pass the filter. Large scans release the
+// GVL, so other threads (including writers to this store) run meanwhile;
+// the search sees the rows present when it started.
+static VALUE vector_store_search(int argc, VALUE *argv, VALUE self) {
+  vector_store_t *store = get_initialized_store(self);
+  VALUE query, rb_k, stats, opts, rb_filter = Qundef;
+  rb_scan_args(argc, argv, "12:", &query, &rb_k, &stats, &opts);
+  if (!NIL_P(stats)) Check_Type(stats, T_HASH);
+  if (!NIL_P(opts)) {
+    static ID keywords[1];
+    if (!keywords[0]) keywords[0] = rb_intern("filter");
+    rb_get_kwargs(opts, keywords, 0, 1, &rb_filter);
+  }
+  rag_bitmap_t *filter = rb_filter == Qundef || NIL_P(rb_filter) ? NULL : rag_get_bitmap(rb_filter);
+
+  long k = NIL_P(rb_k) ? 10 : NUM2LONG(rb_k);
+  if (k < 0) {
+    rb_raise(rb_eArgError, "k must not be negative");
+  }
+
+  size_t size = store->size;
+  if ((size_t)k > size) k = (long)size;
+  int release_gvl = size * (size_t)store->dim >= SCAN_WITHOUT_GVL_VALUES;
+
+  VALUE tmp_query, tmp_hits, tmp_ids;
+  float *q = ALLOCV_N(float, tmp_query, store->dim);
+  rag_read_vector(query, q, store->dim);
+  int64_t *hit_ids = ALLOCV_N(int64_t, tmp_ids, k ? k : 1);
+  rag_topk_t topk;
+  rag_topk_init(&topk, ALLOCV_N(rag_hit_t, tmp_hits, k ? k : 1), (size_t)k);
+
+  // Nothing below raises until the block is released
+  scan_t scan = {store, store->rows, size, q, 0, &topk, filter, 0, !NIL_P(stats), 0, 0};
+  scan.q_inv_norm = norm_scale(store, q);
+
+  RAG_PROBE4(search__start, (uintptr_t)store, scan.size, store->dim, k);
+
+  if (release_gvl) {
+    store->rows->readers++;
+    if (filter) filter->readers++;
+    rb_thread_call_without_gvl(scan_rows, &scan, NULL, NULL);
+    if (filter) filter->readers--;
+  } else {
+    scan_rows(&scan);
+  }
+
+  // Resolve the ids while the block is pinned, then let it go
+  for (size_t i = 0; i < topk.size; ++i) {
+    hit_ids[i] = scan.rows->ids[topk.hits[i].index];
+  }
+  if (release_gvl) release_rows((rows_block_t *)scan.rows, store->dim);
+
+  if (scan.timing) {
+    rb_hash_aset(stats, ID2SYM(rb_intern("rows_scanned")), SIZET2NUM(scan.scored));
+    rb_hash_aset(stats, ID2SYM(rb_intern("scoring_time")), DBL2NUM(scan.scoring_ns / 1e9));
+    rb_hash_aset(stats, ID2SYM(rb_intern("heap_time")), DBL2NUM(scan.heap_ns / 1e9));
+  }
+
+  RAG_PROBE3(search__done, (uintptr_t)store, scan.size, topk.size);
+
+  VALUE result = rb_ary_new_capa((long)topk.size);
+  for (size_t i = 0; i < topk.size; ++i) {
+    rb_ary_push(result, rb_assoc_new(LL2NUM(hit_ids[i]), DBL2NUM(result_score(store, topk.hits[i].score))));
+  }
+
+  ALLOCV_END(tmp_query);
+  ALLOCV_END(tmp_hits);
+  ALLOCV_END(tmp_ids);
+  RB_GC_GUARD(rb_filter);
+  return result;
+}
+
+// Everything a batched scan needs, so it can run without the GVL
+typedef struct {
+  const vector_store_t *store;
+  const rows_block_t *rows;   // Snapshot, as for scan_t
+  size_t size;
+  const float *queries;       // query_count rows of dim values
+  const float *q_inv_norms;
+  size_t query_count;
+  rag_topk_t *topks;          // One heap per query
+  size_t tile_rows;
+  double *scores;             // BATCH_QUERY_BLOCK * tile_rows scores
+} batch_scan_t;
+
+static void *scan_batch(void *ptr) {
+  batch_scan_t *batch = (batch_scan_t *)ptr;
+  size_t dim = batch->store->dim;
+  for (size_t first = 0; first < batch->query_count; first += BATCH_QUERY_BLOCK) {
+    size_t queries = batch->query_count - first < BATCH_QUERY_BLOCK ? batch->query_count - first : BATCH_QUERY_BLOCK;
+    rag_topk_t *topks = batch->topks + first;
+    for (size_t start = 0; start < batch->size; start += batch->tile_rows) {
+      size_t count = batch->size - start < batch->tile_rows ? batch->size - start : batch->tile_rows;
+      rag_score_tile(batch->queries + first * dim, batch->q_inv_norms + first, queries,
+                     batch->rows->vectors + start * dim, batch->rows->inv_norms + start, count, dim, batch->scores);
+      for (size_t q = 0; q < queries; ++q) {
+        const double *scores = batch->scores + q * count;
+        for (size_t i = 0; i < count; ++i) {
+          rag_topk_push(&topks[q], scores[i], start + i);
+        }
+      }
+    }
+    for (size_t q = 0; q < queries; ++q) {
+      rag_topk_sort(&topks[q]);
+    }
+  }
+  return NULL;
+}
+
+// Instance method: store.search_batch(queries, k = 10)
+// Exact top-k for many queries at once: returns one [[id, similarity], ...]
+// list per query, as search would. The queries are scored together against
+// cache-sized tiles of rows (see rag_score_tile), which is much cheaper than
+// one full scan per query for evaluation or deduplication jobs. Releases
+// the GVL like search.
+static VALUE vector_store_search_batch(int argc, VALUE *argv, VALUE self) {
+  vector_store_t *store = get_initialized_store(self);
+  VALUE queries, rb_k;
+  rb_scan_args(argc, argv, "11", &queries, &rb_k);
+  Check_Type(queries, T_ARRAY);
+
+  long k = NIL_P(rb_k) ? 10 : NUM2LONG(rb_k);
+  if (k < 0) {
+    rb_raise(rb_eArgError, "k must not be negative");
+  }
+
+  size_t query_count = (size_t)RARRAY_LEN(queries);
+  size_t size = store->size;
+  if ((size_t)k > size) k = (long)size;
+  size_t dim = store->dim;
+  if (query_count && (dim > SIZE_MAX / sizeof(float) / query_count ||
+                      (k && (size_t)k > SIZE_MAX / sizeof(rag_hit_t) / query_count))) {
+    rb_raise(rb_eNoMemError, "Too many queries");
+  }
+
+  size_t tile_rows = BATCH_TILE_BYTES / (dim * sizeof(float));
+  if (tile_rows < RAG_TILE_QUERIES) tile_rows = RAG_TILE_QUERIES;
+  if (tile_rows > BATCH_TILE_MAX_ROWS) tile_rows = BATCH_TILE_MAX_ROWS;
+
+  VALUE tmp_queries, tmp_norms, tmp_topks, tmp_hits, tmp_ids, tmp_scores;
+  size_t slots = query_count ? query_count : 1;
+  float *matrix = ALLOCV_N(float, tmp_queries, slots * dim);
+  float *q_inv_norms = ALLOCV_N(float, tmp_norms, slots);
+  for (size_t q = 0; q < query_count; ++q) {
+    rag_read_vector(rb_ary_entry(queries, (long)q), matrix + q * dim, store->dim);
+    q_inv_norms[q] = norm_scale(store, matrix + q * dim);
+  }
+  rag_topk_t *topks = ALLOCV_N(rag_topk_t, tmp_topks, slots);
+  rag_hit_t *hits = ALLOCV_N(rag_hit_t, tmp_hits, k ? slots * (size_t)k : 1);
+  int64_t *hit_ids = ALLOCV_N(int64_t, tmp_ids, k ? slots * (size_t)k : 1);
+  for (size_t q = 0; q < query_count; ++q) {
+    rag_topk_init(&topks[q], hits + q * (size_t)k, (size_t)k);
+  }
+  double *scores = ALLOCV_N(double, tmp_scores, BATCH_QUERY_BLOCK * tile_rows);
+
+  // Nothing below raises until the block is released
+  batch_scan_t batch = {store, store->rows, size, matrix, q_inv_norms, query_count, topks, tile_rows, scores};
+  int release_gvl = query_count * size * dim >= SCAN_WITHOUT_GVL_VALUES;
+  if (release_gvl) {
+    store->rows->readers++;
+    rb_thread_call_without_gvl(scan_batch, &batch, NULL, NULL);
+  } else if (size) {
+    scan_batch(&batch);
+  }
+  for (size_t q = 0; q < query_count; ++q) {
+    for (size_t i = 0; i < topks[q].size; ++i) {
+      hit_ids[q * (size_t)k + i] = batch.rows->ids[topks[q].hits[i].index];
+    }
+  }
+  if (release_gvl) release_rows((rows_block_t *)batch.rows, store->dim);
+
+  VALUE result = rb_ary_new_capa((long)query_count);
+  for (size_t q = 0; q < query_count; ++q) {
+    VALUE list = rb_ary_new_capa((long)topks[q].size);
+    for (size_t i = 0; i < topks[q].size; ++i) {
+      rb_ary_push(list, rb_assoc_new(LL2NUM(hit_ids[q * (size_t)k + i]), DBL2NUM(result_score(store, topks[q].hits[i].score))));
+    }
+    rb_ary_push(result, list);
+  }
+
+  ALLOCV_END(tmp_queries);
+  ALLOCV_END(tmp_norms);
+  ALLOCV_END(tmp_topks);
+  ALLOCV_END(tmp_hits);
+  ALLOCV_END(tmp_ids);
+  ALLOCV_END(tmp_scores);
+  return result;
+}
+
+// Pairs above the threshold buffered by a similarity join before they are
+// yielded; a step stops after the tile that reaches it
+#define JOIN_FLUSH_PAIRS 4096
+
+typedef struct {
+  size_t a, b;          // Rows of the pair, a < b
+  double score;
+} join_pair_t;
+
+// A similarity join walks the upper triangle of the row-by-row score
+// matrix, one block of BATCH_QUERY_BLOCK rows against the tiles of the rows
+// from the tile holding that block on, without ever materializing it. It runs in steps
+// without the GVL; each step resumes at (first, start) and fills `pairs`.
+typedef struct {
+  const vector_store_t *store;
+  const rows_block_t *rows;   // Snapshot, pinned for the whole join
+  size_t size;
+  double threshold;
+  size_t tile_rows;
+  double *scores;             // BATCH_QUERY_BLOCK * tile_rows scores
+  float *block_norms;         // With the dot metric: max |row| of every block and tile, or NULL
+  float *tile_norms;
+  size_t first;               // Cursor: current block, next tile
+  size_t start;
+  join_pair_t *pairs;
+  size_t count;
+  size_t scored;              // Pairs scored and tiles skipped so far
+  size_t pruned;
+  VALUE stats;                // Hash receiving them, or nil
+  VALUE buffers[4];           // ALLOCV buffers of the arrays above
+} join_t;
+
+// Largest |row| over rows [first, first + count)
+static float max_norm(const vector_store_t *store, const rows_block_t *rows, size_t first, size_t count) {
+  double max = 0.0;
+  for (size_t r = first; r < first + count; ++r) {
+    double norm = store->kernels->dot(rows->vectors + r * (size_t)store->dim, rows->vectors + r * (size_t)store->dim, store->dim);
+    if (norm > max) max = norm;
+  }
+  return (float)sqrt(max) * (1.0f + 1e-6f);   // Rounded up, never prunes a real pair
+}
+
+static void *join_step(void *ptr) {
+  join_t *join = (join_t *)ptr;
+  const vector_store_t *store = join->store;
+  const rows_block_t *rows = join->rows;
+  size_t dim = store->dim;
+  join->count = 0;
+  // Tiles start on tile_rows multiples, so that tile_norms bounds exactly
+  // the rows of every tile; the first one may begin before the block
+  for (; join->first < join->size;
+       join->first += BATCH_QUERY_BLOCK, join->start = join->first / join->tile_rows * join->tile_rows) {
+    size_t block = join->size - join->first < BATCH_QUERY_BLOCK ? join->size - join->first : BATCH_QUERY_BLOCK;
+    for (; join->start < join->size; join->start += join->tile_rows) {
+      size_t start = join->start;
+      size_t count = join->size - start < join->tile_rows ? join->size - start : join->tile_rows;
+      if (join->block_norms &&
+          (double)join->block_norms[join->first / BATCH_QUERY_BLOCK] * join->tile_norms[start / join->tile_rows] < join->threshold) {
+        join->pruned++;
+        continue;
+      }
+      rag_score_tile(rows->vectors + join->first * dim, rows->inv_norms + join->first, block,
+                     rows->vectors + start * dim, rows->inv_norms + start, count, dim, join->scores);
+      join->scored += block * count;
+      for (size_t q = 0; q < block; ++q) {
+        size_t a = join->first + q;
+        const double *scores = join->scores + q * count;
+        // Only b > a: each pair once, no row with itself
+        for (size_t i = a + 1 > start ? a + 1 - start : 0; i < count; ++i) {
+          if (scores[i] >= join->threshold) {
+            join->pairs[join->count].a = a;
+            join->pairs[join->count].b = start + i;
+            join->pairs[join->count].score = scores[i];
+            join->count++;
+          }
+        }
+      }
+      if (join->count >= JOIN_FLUSH_PAIRS) {
+        join->start += join->tile_rows;
+        return NULL;
+      }
+    }
+  }
+  return NULL;
+}
+
+// Norm bounds for the dot metric: |a . b| <= |a| |b|, so a block and a
+// tile whose largest norms multiply below the threshold hold no pair
+static void *join_bounds(void *ptr) {
+  join_t *join = (join_t *)ptr;
+  for (size_t first = 0; first < join->size; first += BATCH_QUERY_BLOCK) {
+    size_t count = join->size - first < BATCH_QUERY_BLOCK ? join->size - first : BATCH_QUERY_BLOCK;
+    join->block_norms[first / BATCH_QUERY_BLOCK] = max_norm(join->store, join->rows, first, count);
+  }
+  for (size_t start = 0; start < join->size; start += join->tile_rows) {
+    size_t count = join->size - start < join->tile_rows ? join->size - start : join->tile_rows;
+    join->tile_norms[start / join->tile_rows] = max_norm(join->store, join->rows, start, count);
+  }
+  return NULL;
+}
+
+static VALUE join_run(VALUE arg) {
+  join_t *join = (join_t *)arg;
+  int release_gvl = join->size * (size_t)join->store->dim >= SCAN_WITHOUT_GVL_VALUES;
+  if (join->block_norms) {
+    if (release_gvl) {
+      rb_thread_call_without_gvl(join_bounds, join, NULL, NULL);
+    } else {
+      join_bounds(join);
+    }
+  }
+
+  size_t found = 0;
+  while (join->first < join->size) {
+    if (release_gvl) {
+      rb_thread_call_without_gvl(join_step, join, NULL, NULL);
+    } else {
+      join_step(join);
+    }
+    for (size_t i = 0; i < join->count; ++i) {
+      const join_pair_t *pair = &join->pairs[i];
+      rb_yield_values(3, LL2NUM(join->rows->ids[pair->a]), LL2NUM(join->rows->ids[pair->b]),
+                      DBL2NUM(result_score(join->store, pair->score)));
+    }
+    found += join->count;
+  }
+  if (!NIL_P(join->stats)) {
+    rb_hash_aset(join->stats, ID2SYM(rb_intern("pairs_scored")), SIZET2NUM(join->scored));
+    rb_hash_aset(join->stats, ID2SYM(rb_intern("tiles_pruned")), SIZET2NUM(join->pruned));
+  }
+  return SIZET2NUM(found);
+}
+
+static VALUE join_release(VALUE arg) {
+  join_t *join = (join_t *)arg;
+  release_rows((rows_block_t *)join->rows, join->store->dim);
+  for (int i = 0; i < 4; ++i) {
+    if (join->buffers[i]) ALLOCV_END(join->buffers[i]);
+  }
+  return Qnil;
+}
+
+// Instance method: store.similarity_join(threshold:, stats: nil) { |id_a, id_b, similarity| ... }
+// Yields every pair of rows whose similarity is at least threshold, each
+// pair once, in row order; returns the number of pairs (an Enumerator
+// without a block). Blocks of rows are scored against tiles of rows as a
+// matrix product (rag_score_tile) and pairs are yielded in small batches,
+// so memory stays flat whatever the store size. With the dot metric, tiles
+// that norm bounds rule out are skipped. A Hash given as stats receives
+// :pairs_scored and :tiles_pruned. The join reads the rows present when it
+// started; the scoring runs without the GVL.
+static VALUE vector_store_similarity_join(int argc, VALUE *argv, VALUE self) {
+  RETURN_ENUMERATOR_KW(self, argc, argv, rb_keyword_given_p());
+  vector_store_t *store = get_initialized_store(self);
+  VALUE opts;
+  rb_scan_args(argc, argv, ":", &opts);
+  static ID keywords[2];
+  if (!keywords[0]) {
+    keywords[0] = rb_intern("threshold");
+    keywords[1] = rb_intern("stats");
+  }
+  VALUE values[2];
+  rb_get_kwargs(opts, keywords, 1, 1, values);
+
+  join_t join;
+  memset(&join, 0, sizeof(join));
+  join.stats = values[1] == Qundef ? Qnil : values[1];
+  if (!NIL_P(join.stats)) Check_Type(join.stats, T_HASH);
+  join.store = store;
+  join.rows = store->rows;
+  join.size = store->size;
+  join.threshold = NUM2DBL(values[0]);
+  if (isnan(join.threshold)) {
+    rb_raise(rb_eArgError, "threshold must be a number");
+  }
+  join.tile_rows = BATCH_TILE_BYTES / ((size_t)store->dim * sizeof(float));
+  if (join.tile_rows < RAG_TILE_QUERIES) join.tile_rows = RAG_TILE_QUERIES;
+  if (join.tile_rows > BATCH_TILE_MAX_ROWS) join.tile_rows = BATCH_TILE_MAX_ROWS;
+
+  if (!join.size) return join_run((VALUE)&join);
+
+  join.scores = ALLOCV_N(double, join.buffers[0], BATCH_QUERY_BLOCK * join.tile_rows);
+  join.pairs = ALLOCV_N(join_pair_t, join.buffers[1], JOIN_FLUSH_PAIRS + BATCH_QUERY_BLOCK * join.tile_rows);
+  if (store->metric == RAG_METRIC_DOT) {
+    join.block_norms = ALLOCV_N(float, join.buffers[2], join.size / BATCH_QUERY_BLOCK + 1);
+    join.tile_norms = ALLOCV_N(float, join.buffers[3], join.size / join.tile_rows + 1);
+  }
+
+  // Nothing below raises until the rows are pinned
+  store->rows->readers++;
+  // The block may break out of the join or raise: unpin the rows anyway
+  return rb_ensure(join_run, (VALUE)&join, join_release, (VALUE)&join);
+}
+
+static inline uint64_t align_offset(uint64_t offset) {
+  return (offset + RAG_ALIGNMENT - 1) & ~(uint64_t)(RAG_ALIGNMENT - 1);
+}
+
+// Lays out the sections of a store file for `rows` rows of `dim` values
+static store_file_header_t store_file_header(uint32_t dim, size_t rows) {
+  store_file_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, STORE_FILE_MAGIC, sizeof(header.magic));
+  header.version = STORE_FILE_VERSION;
+  header.endian = STORE_FILE_ENDIAN;
+  header.dim = dim;
+  header.rows = rows;
+  header.ids_offset = sizeof(header);
+  header.inv_norms_offset = align_offset(header.ids_offset + rows * sizeof(int64_t));
+  header.vectors_offset = align_offset(header.inv_norms_offset + rows * sizeof(float));
+  header.bytes = header.vectors_offset + (uint64_t)rows * dim * sizeof(float);
+  return header;
+}
+
+// Writes `bytes` bytes at `offset`, after zero padding from the current position
+static int write_section(FILE *file, uint64_t *position, uint64_t offset, const void *data, size_t bytes) {
+  static const char zeros[RAG_ALIGNMENT];
+  if (offset - *position > sizeof(zeros)) return 0;
+  if (fwrite(zeros, 1, offset - *position, file) != offset - *position) return 0;
+  if (bytes && fwrite(data, 1, bytes, file) != bytes) return 0;
+  *position = offset + bytes;
+  return 1;
+}
+
+// Instance method: store.save(path)
+// Writes the store to a file that VectorStore.map can share between
+// processes. The file is written next to `path` and renamed over it, so
+// readers always see either the previous generation or the new one.
+static VALUE vector_store_save(VALUE self, VALUE rb_path) {
+  vector_store_t *store = get_vector_store(self);
+  FilePathValue(rb_path);
+  // Unique per process and per call, so concurrent saves to one path never
+  // share a temporary file; the counter is only touched under the GVL
+  static unsigned long save_sequence = 0;
+  VALUE rb_tmp = rb_sprintf("%"PRIsVALUE".tmp.%ld.%lu", rb_path, (long)getpid(), ++save_sequence);
+  const char *path = StringValueCStr(rb_path);
+  const char *tmp = StringValueCStr(rb_tmp);
+
+  store_file_header_t header = store_file_header(store->dim, store->size);
+  header.metric = store->metric;
+  FILE *file = fopen(tmp, "wbx");   // Fails rather than reuse a leftover file
+  if (!file) rb_sys_fail_str(rb_tmp);
+
+  // No Ruby code runs while writing, so the rows cannot change underneath
+  static const rows_block_t empty;
+  const rows_block_t *rows = store->rows ? store->rows : &empty;
+  uint64_t position = 0;
+  int ok = write_section(file, &position, 0, &header, sizeof(header)) &&
+           write_section(file, &position, header.ids_offset, rows->ids, store->size * sizeof(int64_t)) &&
+           write_section(file, &position, header.inv_norms_offset, rows->inv_norms, store->size * sizeof(float)) &&
+           write_section(file, &position, header.vectors_offset, rows->vectors,
+                         store->size * (size_t)store->dim * sizeof(float)) &&
+           fflush(file) == 0;
+#ifdef HAVE_SYS_MMAN_H
+  // Durable before it becomes visible under the final name
+  ok = ok && fsync(fileno(file)) == 0;
+#endif
+  ok = (fclose(file) == 0) && ok;
+  if (!ok || rename(tmp, path) != 0) {
+    int error = errno;
+    remove(tmp);
+    errno = error;
+    rb_sys_fail_str(rb_path);
+  }
+  return self;
+}
+
+// Class method: RagEmbeddings::VectorStore.map(path)
+// Returns a read-only (frozen) store backed by a MAP_SHARED mapping of a
+// file written by VectorStore#save. Processes mapping the same file share
+// one copy of the rows in the page cache, so preforked workers do not pay
+// for their own. The mapping stays valid after the file is replaced.
+static VALUE vector_store_map(VALUE klass, VALUE rb_path) {
+#ifdef HAVE_SYS_MMAN_H
+  FilePathValue(rb_path);
+  const char *path = StringValueCStr(rb_path);
+
+  // Allocated first, so the mapping is released by the GC if validation raises
+  VALUE obj = vector_store_alloc(klass);
+  vector_store_t *store = get_vector_store(obj);
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) rb_sys_fail_str(rb_path);
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    int error = errno;
+    close(fd);
+    errno = error;
+    rb_sys_fail_str(rb_path);
+  }
+  if ((uint64_t)st.st_size < sizeof(store_file_header_t)) {
+    close(fd);
+    rb_raise(rb_eArgError, "%s is not a VectorStore file", path);
+  }
+
+  void *mapping = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) rb_sys_fail_str(rb_path);
+  rows_block_t *rows = store->rows = ZALLOC(rows_block_t);
+  rows->mapping = mapping;
+  rows->mapping_bytes = (size_t)st.st_size;
+  live_mapped_bytes += rows->mapping_bytes;
+
+  store_file_header_t header;
+  memcpy(&header, mapping, sizeof(header));
+  if (memcmp(header.magic, STORE_FILE_MAGIC, sizeof(header.magic)) != 0) {
+    rb_raise(rb_eArgError, "%s is not a VectorStore file", path);
+  }
+  if (header.version != STORE_FILE_VERSION || header.endian != STORE_FILE_ENDIAN) {
+    rb_raise(rb_eArgError, "%s was written by another version or architecture", path);
+  }
+  uint32_t dim = rag_check_dim((long)header.dim);
+  if (header.metric != RAG_METRIC_COSINE && header.metric != RAG_METRIC_DOT) {
+    rb_raise(rb_eArgError, "%s is truncated or corrupted", path);
+  }
+  if (header.rows > (uint64_t)st.st_size / sizeof(float) / dim) {
+    rb_raise(rb_eArgError, "%s is truncated or corrupted", path);
+  }
+  store_file_header_t expected = store_file_header(dim, (size_t)header.rows);
+  if (header.ids_offset != expected.ids_offset || header.inv_norms_offset != expected.inv_norms_offset ||
+      header.vectors_offset != expected.vectors_offset || header.bytes != expected.bytes ||
+      header.bytes > (uint64_t)st.st_size) {
+    rb_raise(rb_eArgError, "%s is truncated or corrupted", path);
+  }
+
+  // Scans read the whole file: ask the kernel to start reading it now
+  madvise(mapping, rows->mapping_bytes, MADV_WILLNEED);
+
+  char *base = (char *)mapping;
+  store->dim = header.dim;
+  store->metric = (rag_metric_t)header.metric;
+  store->kernels = rag_kernels_for(store->dim);
+  rows->ids = (int64_t *)(base + header.ids_offset);
+  rows->inv_norms = (float *)(base + header.inv_norms_offset);
+  rows->vectors = (float *)(base + header.vectors_offset);
+  store->size = rows->capacity = (size_t)header.rows;
+  live_rows += store->size;
+  RAG_PROBE3(store__map, (uintptr_t)store, store->size, rows->mapping_bytes);
+
+  return rb_obj_freeze(obj);
+#else
+  rb_raise(rb_eNotImpError, "VectorStore.map needs mmap, not available on this platform");
+#endif
+}
+
+// Class method: RagEmbeddings::VectorStore.memory_stats
+// Returns { stores:, rows:, bytes:, mapped_bytes: } summed over all the live
+// stores of the process (mapped_bytes are shared file mappings, not heap)
+static VALUE vector_store_memory_stats(VALUE klass) {
+  VALUE stats = rb_hash_new();
+  rb_hash_aset(stats, ID2SYM(rb_intern("stores")), SIZET2NUM(live_stores));
+  rb_hash_aset(stats, ID2SYM(rb_intern("rows")), SIZET2NUM(live_rows));
+  rb_hash_aset(stats, ID2SYM(rb_intern("bytes")), SIZET2NUM(live_bytes));
+  rb_hash_aset(stats, ID2SYM(rb_intern("mapped_bytes")), SIZET2NUM(live_mapped_bytes));
+  return stats;
+}
+
+// Instance method: store.size
+static VALUE vector_store_size(VALUE self) {
+  return SIZET2NUM(get_vector_store(self)->size);
+}
+
+// Instance method: store.dim
+static VALUE vector_store_dim(VALUE self) {
+  return UINT2NUM(get_vector_store(self)->dim);
+}
+
+// Instance method: store.metric
+static VALUE vector_store_metric(VALUE self) {
+  return rag_metric_sym(get_vector_store(self)->metric);
+}
+
+// Instance method: store.mapped?
+// True for a store returned by VectorStore.map
+static VALUE vector_store_mapped_p(VALUE self) {
+  vector_store_t *store = get_vector_store(self);
+  return store->rows && store->rows->mapping ? Qtrue : Qfalse;
+}
+
+void Init_vector_store(VALUE mRag) {
+  VALUE cVectorStore = rb_define_class_under(mRag, "VectorStore", rb_cObject);
+  rb_define_alloc_func(cVectorStore, vector_store_alloc);
+
+  rb_define_singleton_method(cVectorStore, "memory_stats", vector_store_memory_stats, 0);
+  rb_define_singleton_method(cVectorStore, "map", vector_store_map, 1);
+
+  rb_define_method(cVectorStore, "initialize", vector_store_initialize, -1);
+  rb_define_method(cVectorStore, "add", vector_store_add, 2);
+  rb_define_method(cVectorStore, "add_packed", vector_store_add_packed, 2);
+  rb_define_method(cVectorStore, "delete", vector_store_delete, 1);
+  rb_define_method(cVectorStore, "delete_many", vector_store_delete_many, 1);
+  rb_define_method(cVectorStore, "search", vector_store_search, -1);
+  rb_define_method(cVectorStore, "search_batch", vector_store_search_batch, -1);
+  rb_define_method(cVectorStore, "similarity_join", vector_store_similarity_join, -1);
+  rb_define_method(cVectorStore, "size", vector_store_size, 0);
+  rb_define_method(cVectorStore, "dim", vector_store_dim, 0);
+  rb_define_method(cVectorStore, "metric", vector_store_metric, 0);
+  rb_define_method(cVectorStore, "mapped?", vector_store_mapped_p, 0);
+  rb_define_method(cVectorStore, "save", vector_store_save, 1);
+}
@@ -1,8 +1,18 @@
 require_relative "rag_embeddings/version"
 require_relative "rag_embeddings/engine"
+require_relative "rag_embeddings/providers/base"
+require_relative "rag_embeddings/providers/ollama"
+require_relative "rag_embeddings/providers/local"
+require_relative "rag_embeddings/metrics"
+require_relative "rag_embeddings/search_stats"
+require_relative "rag_embeddings/collection"
 require_relative "rag_embeddings/database"
+require_relative "rag_embeddings/ingestor"
 
 # Loads the compiled C extension
 require "rag_embeddings/embedding"
+require_relative "rag_embeddings/chunker"
+require_relative "rag_embeddings/shared_store"
+require_relative "rag_embeddings/batch_scheduler"
 
 require "faraday"
@@ -0,0 +1,127 @@
+module RagEmbeddings
+  # Coalesces the searches that threads run on one store at the same moment
+  # into batched scans (VectorStore#search_batch), so under load the rows
+  # are read from memory once per batch instead of once per query.
+  #
+  # There is no background thread: the first caller of a batch becomes its
+  # leader, waits up to +window+ seconds (or until +max_batch+ queries are
+  # queued), runs the batch and hands every caller its result. The others
+  # just wait for theirs. A new batch starts forming while the previous one
+  # is scanned, since the scan releases the GVL.
+  #
+  #   SCHEDULER = RagEmbeddings::BatchScheduler.new(RagEmbeddings::SharedStore.new("tmp/embeddings.store"))
+  #   SCHEDULER.search(query_embedding, 5) # => [[id, similarity], ...], from any thread
+  #
+  # A lone query pays up to +window+ of extra latency: keep it well under
+  # the scan time of the store.
+  class BatchScheduler
+    # Raised in the callers of a batch whose leader was interrupted by an
+    # exception that is not a StandardError (e.g. Interrupt)
+    class Aborted < StandardError; end
+
+    Request = Struct.new(:query, :k, :result, :error, :queued, :done)
+
+    attr_reader :store, :window, :max_batch
+
+    # store - a VectorStore, SharedStore or anything answering
+    #         search_batch(queries, k) and dim
+    def initialize(store, window: 0.002, max_batch: 64)
+      raise ArgumentError, "window must not be negative" if window.negative?
+      raise ArgumentError, "max_batch must be positive" unless max_batch.positive?
+
+      @store = store
+      @window = window
+      @max_batch = max_batch
+      @mutex = Mutex.new
+      @full = ConditionVariable.new
+      @done = ConditionVariable.new
+      @pending = []
+      @collecting = false
+    end
+
+    # Same result as store.search(query, k), once the batch it joined has run
+    def search(query, k = 10)
+      request = Request.new(embedding(query), k, nil, nil, true)
+      @mutex.synchronize do
+        @pending << request
+        @full.signal if @pending.size >= @max_batch
+      end
+      # Wait while another thread collects or runs our request; lead the
+      # next batch otherwise. A leader may run a batch without its own
+      # request when more than max_batch were queued, then goes around again.
+      loop do
+        batch = @mutex.synchronize do
+          @done.wait(@mutex) while !request.done && (@collecting || !request.queued)
+          collect(request) unless request.done
+        end
+        break unless batch
+
+        run(batch)
+      end
+      raise request.error if request.error
+
+      request.result
+    end
+
+    private
+
+    # Called with the mutex held by the leader: waits for the batch to fill
+    # or the window to end, and takes the queued requests. A leader
+    # interrupted while waiting (Timeout, Thread#raise) withdraws its own
+    # request and hands the others to a new leader.
+    def collect(leader)
+      @collecting = true
+      batch = nil
+      deadline = now + @window
+      while @pending.size < @max_batch && (remaining = deadline - now).positive?
+        @full.wait(@mutex, remaining)
+      end
+      batch = @pending.shift(@max_batch)
+      batch.each { |request| request.queued = false }
+      batch
+    ensure
+      @collecting = false
+      @pending.delete(leader) unless batch
+      # Requests left over from a full batch elect their own leader now
+      # instead of waiting for this batch to finish
+      @done.broadcast unless @pending.empty?
+    end
+
+    # One scan for the whole batch at the largest k, each caller keeping its own k
+    def run(batch)
+      finished = false
+      k = batch.map(&:k).max
+      lists = @store.search_batch(batch.map(&:query), k)
+      batch.zip(lists) { |request, hits| request.result = hits.first(request.k) }
+      RagEmbeddings.metrics.increment(:search_batches_total)
+      RagEmbeddings.metrics.increment(:batched_searches_total, batch.size)
+      finished = true
+    rescue StandardError => e
+      batch.each { |request| request.error = e }
+      finished = true
+    ensure
+      @mutex.synchronize do
+        batch.each do |request|
+          request.error = Aborted.new("the batch was interrupted") unless finished
+          request.done = true
+        end
+        @done.broadcast
+      end
+    end
+
+    # Checks the query in the caller's thread, so a bad one fails alone
+    # instead of failing its whole batch
+    def embedding(query)
+      embedding = query.is_a?(Embedding) ? query : Embedding.from_array(query)
+      if embedding.dim != @store.dim
+        raise ArgumentError, "Dimension mismatch: #{embedding.dim} vs #{@store.dim}"
+      end
+
+      embedding
+    end
+
+    def now
+      Process.clock_gettime(Process::CLOCK_MONOTONIC)
+    end
+  end
+end
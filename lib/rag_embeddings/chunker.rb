@@ -0,0 +1,24 @@
+module RagEmbeddings
+  # Splits text into overlapping chunks sized for an embedding model.
+  # The scanning is done in C (see ext/rag_embeddings/chunker.c): #offsets
+  # returns byte ranges, so large documents are never copied chunk by chunk
+  # unless the caller asks for the strings.
+  #
+  #   chunker = RagEmbeddings::Chunker.new(max_bytes: 1500, overlap: 200)
+  #   chunker.offsets(text)  # => [[0, 1432], [1251, 1488], ...]
+  #   chunker.split(text)    # => ["First paragraph...", "...overlapping second chunk", ...]
+  class Chunker
+    # Returns the chunks of +text+ as strings
+    def split(text)
+      offsets(text).map { |offset, length| text.byteslice(offset, length) }
+    end
+    alias call split
+
+    # Yields each chunk with its byte offset, without building the whole list of strings
+    def each_chunk(text)
+      return enum_for(:each_chunk, text) unless block_given?
+
+      offsets(text).each { |offset, length| yield text.byteslice(offset, length), offset }
+    end
+  end
+end
@@ -0,0 +1,653 @@
+require "digest"
+
+module RagEmbeddings
+  # A set of rows with one dimension, storage type and metric, in its own
+  # SQLite table and, with index: true, its own native VectorStore, so a
+  # search only reads the rows of its collection. Obtained from
+  # Database#collection; the Database itself is the default collection.
+  class Collection
+    # Typed metadata columns, besides content and embedding. Tags live in
+    # their own table, one row per (tag, embedding).
+    METADATA_COLUMNS = { tenant_id: "TEXT", doc_id: "TEXT", created_at: "INTEGER", updated_at: "INTEGER" }.freeze
+    METADATA = (METADATA_COLUMNS.keys + [:tags]).freeze
+
+    # Storage types of the vectors, with their Array#pack format. The native
+    # code reads native-endian float32 blobs.
+    DTYPES = { float32: "f*" }.freeze
+    METRICS = %i[cosine dot].freeze
+
+    # dedup: modes of insert and insert_many, and the similarity (in the
+    # metric of the collection) from which :near takes a row for a duplicate
+    DEDUP_MODES = %i[exact near].freeze
+    DEDUP_THRESHOLD = 0.98
+
+    # Index size (rows * dim) from which VectorStore#search releases the GVL:
+    # from there hybrid_search runs the vector search in a thread, alongside
+    # the BM25 query
+    CONCURRENT_SCAN_VALUES = 1 << 16
+
+    # Ids per IN (...) query, below SQLITE_MAX_VARIABLE_NUMBER of older builds (999)
+    CONTENT_SLICE = 500
+
+    attr_reader :name, :dim, :dtype, :metric
+
+    # With index: true the table is also kept in a native VectorStore that
+    # top_k_similar searches instead of scanning SQLite. Searches on the index
+    # release the GVL and never wait for writers: each one reads a consistent
+    # snapshot of the rows while inserts and deletes go on.
+    #
+    # Writers of every collection of a Database share its write_lock, as they
+    # share its SQLite connection.
+    def initialize(db, table:, tags_table:, write_lock:, name: nil, registry_id: nil,
+                   dim: nil, dtype: :float32, metric: :cosine, index: false)
+      raise ArgumentError, "unknown dtype: #{dtype}" unless DTYPES.key?(dtype.to_sym)
+      raise ArgumentError, "unknown metric: #{metric}" unless METRICS.include?(metric.to_sym)
+
+      @db = db
+      @table = table
+      @tags_table = tags_table
+      @write_lock = write_lock
+      @name = name
+      @registry_id = registry_id
+      @dim = dim
+      @dtype = dtype.to_sym
+      @metric = metric.to_sym
+      @pack = DTYPES.fetch(@dtype)
+      columns = "content, embedding, content_hash, #{METADATA_COLUMNS.keys.join(", ")}"
+      values = "?, ?, ?#{", ?" * METADATA_COLUMNS.size}"
+      @insert_sql = "INSERT INTO #{@table} (#{columns}) VALUES (#{values})"
+      # Writes nothing when a row has the same content hash, in one statement
+      @insert_unique_sql = "INSERT INTO #{@table} (#{columns}) SELECT #{values} " \
+                           "WHERE NOT EXISTS (SELECT 1 FROM #{@table} WHERE content_hash = ?)"
+      create_schema
+      @fts_table = "#{@table}_fts"
+      @fts = create_fts
+      @indexed = index
+      @index = vector_store if index
+    end
+
+    # Metadata: tenant_id:, doc_id:, tags: (Array of Strings), created_at:
+    # and updated_at: (Time or Integer seconds, both default to now).
+    # Returns the id of the new row, or nil when dedup: skipped it:
+    #
+    #   :exact  the content is already stored (same SHA-256, looked up
+    #           through the indexed content_hash column)
+    #   :near   a stored vector is at least dedup_threshold similar, probed
+    #           on the index: needs index: true (see insert_many otherwise)
+    def insert(text, embedding, dedup: nil, dedup_threshold: DEDUP_THRESHOLD, **metadata)
+      check_dedup(dedup)
+      if dedup == :near && !@indexed
+        raise ArgumentError, "dedup: :near needs index: true for insert, use insert_many without an index"
+      end
+      values = metadata_values(metadata)
+      id = nil
+      RagEmbeddings.metrics.time(:insert_duration_seconds) do
+        @write_lock.synchronize do
+          blob = pack(embedding)
+          next if dedup == :near && near_duplicate?(embedding, dedup_threshold)
+
+          @db.transaction do
+            @db.execute(dedup == :exact ? @insert_unique_sql : @insert_sql, row_binds(text, blob, values, dedup))
+            id = @db.last_insert_row_id if dedup != :exact || @db.changes.positive?
+            insert_tags(id, metadata[:tags]) if id
+          end
+          index_add(id, blob) if id
+        end
+      end
+      count_inserts(id ? 1 : 0, id ? 0 : 1)
+      id
+    end
+
+    # Inserts many [text, embedding] or [text, embedding, metadata] rows in a
+    # single transaction with one prepared statement. Returns the number of
+    # rows written. dedup: works as for insert, also between the rows of
+    # the batch. For :near, the whole batch is probed with one
+    # VectorStore#search_batch, on the index or, without index: true, on
+    # the table loaded once for the call: re-ingest in large batches.
+    def insert_many(rows, dedup: nil, dedup_threshold: DEDUP_THRESHOLD)
+      check_dedup(dedup)
+      written = 0
+      RagEmbeddings.metrics.time(:insert_duration_seconds) do
+        @write_lock.synchronize do
+          added = []
+          if dedup == :near
+            queries = rows.map { |_, embedding, _| query_embedding(embedding) }
+            stored = stored_near_duplicates(queries, dedup_threshold)
+            batch = nil # accepted rows of this batch
+          end
+          @db.transaction do
+            @db.prepare(dedup == :exact ? @insert_unique_sql : @insert_sql) do |stmt|
+              rows.each_with_index do |(text, embedding, metadata), i|
+                metadata ||= {}
+                blob = pack(embedding)
+                if dedup == :near
+                  next if stored[i] || (batch && similar?(batch.search(queries[i], 1).first, dedup_threshold))
+
+                  (batch ||= RagEmbeddings::VectorStore.new(queries[i].dim, metric: @metric)).add(i, queries[i])
+                end
+                stmt.execute(*row_binds(text, blob, metadata_values(metadata), dedup))
+                next if dedup == :exact && @db.changes.zero?
+
+                id = @db.last_insert_row_id
+                insert_tags(id, metadata[:tags])
+                added << [id, blob] if @indexed
+                written += 1
+              end
+            end
+          end
+          # Only committed rows become visible to searches
+          added.each { |id, blob| index_add(id, blob) }
+        end
+      end
+      count_inserts(written, rows.size - written)
+      written
+    end
+
+    # Deletes a row; returns true if it existed
+    def delete(id)
+      @write_lock.synchronize do
+        @db.execute("DELETE FROM #{@table} WHERE id = ?", [id])
+        deleted = @db.changes.positive?
+        @db.execute("DELETE FROM #{@tags_table} WHERE embedding_id = ?", [id])
+        @index&.delete(id)
+        deleted
+      end
+    end
+
+    # Deletes the rows with the given ids in one transaction; returns the
+    # number of rows deleted. The index copies its rows at most once, even
+    # while searches read it.
+    def delete_many(ids)
+      @write_lock.synchronize do
+        deleted = 0
+        @db.transaction do
+          ids.each_slice(CONTENT_SLICE) do |slice|
+            marks = (["?"] * slice.size).join(", ")
+            @db.execute("DELETE FROM #{@table} WHERE id IN (#{marks})", slice)
+            deleted += @db.changes
+            @db.execute("DELETE FROM #{@tags_table} WHERE embedding_id IN (#{marks})", slice)
+          end
+        end
+        @index&.delete_many(ids)
+        deleted
+      end
+    end
+
+    # Rebuilds the index from the table, e.g. after rows were written by
+    # another connection. Searches already running finish on the previous
+    # index, which is garbage collected afterwards.
+    def reload_index
+      @write_lock.synchronize { @index = vector_store } if @indexed
+      self
+    end
+
+    def indexed?
+      @indexed
+    end
+
+    def size
+      @db.execute("SELECT COUNT(*) FROM #{@table}").first.first
+    end
+
+    def all
+      @db.execute("SELECT id, content, embedding FROM #{@table}").map do |id, content, blob|
+        [id, content, blob.unpack(@pack)]
+      end
+    end
+
+    # Loads every row as [id, content, RagEmbeddings::Embedding].
+    # The vectors are decoded in C into a single aligned arena, one
+    # allocation for the whole table instead of one per row.
+    def embeddings
+      rows = @db.execute("SELECT id, content, embedding FROM #{@table}")
+      vectors = RagEmbeddings::Embedding.from_blobs(rows.map(&:last))
+      rows.each_with_index.map { |(id, content, _), i| [id, content, vectors[i]] }
+    end
+
+    # Builds a native RagEmbeddings::VectorStore of the whole table, e.g. to
+    # publish it to the workers of a preforking server with
+    # RagEmbeddings::SharedStore. An empty table gives an empty store of the
+    # collection's dim, or nil when no dim was given and no row fixed it yet.
+    def vector_store
+      store = nil
+      @db.execute("SELECT id, embedding FROM #{@table}") do |id, blob|
+        store ||= RagEmbeddings::VectorStore.new(blob.bytesize / 4, metric: @metric)
+        store.add_packed(id, blob)
+      end
+      store || (RagEmbeddings::VectorStore.new(@dim, metric: @metric) if @dim)
+    end
+
+    # "Raw" search: returns the N texts most similar to the query.
+    # The query is a text to embed, or an already computed embedding
+    # (Array of floats or RagEmbeddings::Embedding).
+    #
+    # Rows are streamed from SQLite into a native bounded heap, so only the
+    # k best are kept, and the content is fetched for those k rows only.
+    # Pass a RagEmbeddings::SearchStats as stats: to get the time spent in
+    # each phase.
+    #
+    # where: restricts the search to the rows matching the metadata, before
+    # scoring, so the k results all match even for a small tenant:
+    #
+    #   db.top_k_similar("query", k: 5, where: { tenant_id: "acme", tags: ["faq"], created_at: ((Time.now - 86_400)..) })
+    #
+    # Values may be a single value or an Array (any of them) for tenant_id:
+    # and doc_id:, a tag or an Array (all of them) for tags:, and a value or a
+    # Range for the timestamps. The SQLite scan adds the filter to its query;
+    # the in-memory index gets it as a native RagEmbeddings::Bitmap of ids.
+    def top_k_similar(query, k: 5, stats: nil, where: nil)
+      metrics = RagEmbeddings.metrics
+      metrics.increment(:searches_total)
+      metrics.time(:search_duration_seconds) do
+        next indexed_top_k_similar(query, k, stats, where) if @indexed
+        next timed_top_k_similar(query, k, stats, where) if stats
+
+        topk = RagEmbeddings::TopK.new(query_embedding(query), k, metric: @metric)
+        @db.execute(*scan_query(where)) { |id, blob| topk.push_packed(id, blob) }
+        metrics.increment(:scanned_rows_total, topk.stats[:rows_scanned])
+        with_contents(topk.results)
+      end
+    end
+
+    # Runs the search and returns its RagEmbeddings::SearchStats
+    def explain(query, k: 5, where: nil)
+      RagEmbeddings::SearchStats.new.tap { |stats| top_k_similar(query, k:, stats:, where:) }
+    end
+
+    # Exact top-k for many queries at once, e.g. for evaluation or bulk
+    # deduplication jobs: returns one [[id, content, similarity], ...] list per
+    # query. The queries are scored together in native code against
+    # cache-sized tiles of rows (VectorStore#search_batch), so the rows are
+    # read once per block of queries instead of once per query. Uses the
+    # in-memory index when there is one, otherwise loads the table once.
+    def search_batch(queries, k: 5)
+      metrics = RagEmbeddings.metrics
+      metrics.increment(:searches_total, queries.size)
+      metrics.time(:search_duration_seconds) do
+        query_objs = queries.map { |query| query_embedding(query) }
+        store = @indexed ? @index : vector_store
+        next query_objs.map { [] } unless store
+
+        lists = store.search_batch(query_objs, k)
+        metrics.increment(:scanned_rows_total, store.size * queries.size)
+        contents = column_for("content", lists.flatten(1).map(&:first).uniq)
+        lists.map { |hits| hits.map { |id, similarity| [id, contents[id], similarity] } }
+      end
+    end
+
+    # Diverse search: takes the fetch_k (k * 4, at least 20) most similar rows
+    # and keeps k of them by maximal marginal relevance (RagEmbeddings.mmr),
+    # so near-duplicate chunks do not crowd the context. lambda = 1 is a plain
+    # top-k, lower values favor diversity. Relevance and diversity both use
+    # the metric of the collection. Returns [[id, content, similarity], ...]
+    # in selection order.
+    def mmr_search(query, k: 5, lambda: 0.5, fetch_k: nil, where: nil)
+      fetch_k ||= [k * 4, 20].max
+      metrics = RagEmbeddings.metrics
+      metrics.increment(:searches_total)
+      metrics.time(:search_duration_seconds) do
+        query_obj = query_embedding(query)
+        hits = nearest(query_obj, fetch_k, where)
+        next [] if hits.empty?
+
+        blobs = column_for("embedding", hits.map(&:first))
+        hits = hits.select { |id, _| blobs.key?(id) } # rows deleted since the ranking
+        vectors = RagEmbeddings::Embedding.from_blobs(hits.map { |id, _| blobs[id] })
+        with_contents(RagEmbeddings.mmr(query_obj, vectors, k:, lambda:, metric: @metric).map { |index, _| hits[index] })
+      end
+    end
+
+    # Lexical + vector search: the BM25 ranking of the FTS5 index over content
+    # and the vector ranking (of the text, or of vector when given) are fused
+    # in native code, by reciprocal rank (fusion: :rrf) or by min-max
+    # normalized scores (fusion: :weighted). alpha weights the vector side:
+    # 0 is pure BM25, 1 pure vector. Each side contributes its best
+    # candidates: rows (k * 4, at least 20). Words match as phrases, so
+    # "ERR-4012" or "SKU 123-45" find their exact codes.
+    #
+    # Returns [[id, content, fused_score], ...]. Raises NotImplementedError
+    # when SQLite was built without FTS5.
+    def hybrid_search(text, vector = nil, k: 5, alpha: 0.5, fusion: :rrf, candidates: nil, where: nil)
+      raise NotImplementedError, "hybrid_search needs SQLite with FTS5" unless @fts
+      raise ArgumentError, "alpha must be between 0 and 1" unless alpha.between?(0, 1)
+
+      candidates ||= [k * 4, 20].max
+      metrics = RagEmbeddings.metrics
+      metrics.increment(:searches_total)
+      metrics.time(:search_duration_seconds) do
+        query_obj = query_embedding(vector || text)
+        lexical, semantic = hybrid_rankings(text, query_obj, candidates, where)
+        with_contents(RagEmbeddings.fuse([lexical, semantic], k:, weights: [1.0 - alpha, alpha], method: fusion))
+      end
+    end
+
+    private
+
+    # Creates the tables, and adds the metadata and content_hash columns to
+    # tables created by older versions
+    def create_schema
+      @db.execute <<~SQL
+        CREATE TABLE IF NOT EXISTS #{@table} (
+          id INTEGER PRIMARY KEY AUTOINCREMENT,
+          content TEXT NOT NULL,
+          embedding BLOB NOT NULL
+        );
+      SQL
+      columns = @db.execute("PRAGMA table_info(#{@table})").map { |column| column[1] }
+      METADATA_COLUMNS.each do |name, type|
+        @db.execute("ALTER TABLE #{@table} ADD COLUMN #{name} #{type}") unless columns.include?(name.to_s)
+      end
+      @db.execute("CREATE INDEX IF NOT EXISTS #{@table}_tenant_id ON #{@table} (tenant_id)")
+      @db.execute("CREATE INDEX IF NOT EXISTS #{@table}_doc_id ON #{@table} (doc_id)")
+      add_content_hashes unless columns.include?("content_hash")
+      @db.execute("CREATE INDEX IF NOT EXISTS #{@table}_content_hash ON #{@table} (content_hash)")
+      @db.execute <<~SQL
+        CREATE TABLE IF NOT EXISTS #{@tags_table} (
+          tag TEXT NOT NULL,
+          embedding_id INTEGER NOT NULL,
+          PRIMARY KEY (tag, embedding_id)
+        ) WITHOUT ROWID;
+      SQL
+      @db.execute("CREATE INDEX IF NOT EXISTS #{@tags_table}_embedding_id ON #{@tags_table} (embedding_id)")
+    end
+
+    # Full-text index over content, kept in sync by triggers (so rows written
+    # by any connection are indexed) and filled from the existing rows when
+    # created. Returns false when SQLite has no FTS5.
+    def create_fts
+      created = @db.execute("SELECT 1 FROM sqlite_master WHERE name = ?", [@fts_table]).empty?
+      @db.execute("CREATE VIRTUAL TABLE IF NOT EXISTS #{@fts_table} " \
+                  "USING fts5(content, content='#{@table}', content_rowid='id')")
+      @db.execute <<~SQL
+        CREATE TRIGGER IF NOT EXISTS #{@table}_fts_insert AFTER INSERT ON #{@table} BEGIN
+          INSERT INTO #{@fts_table} (rowid, content) VALUES (new.id, new.content);
+        END;
+      SQL
+      @db.execute <<~SQL
+        CREATE TRIGGER IF NOT EXISTS #{@table}_fts_delete AFTER DELETE ON #{@table} BEGIN
+          INSERT INTO #{@fts_table} (#{@fts_table}, rowid, content) VALUES ('delete', old.id, old.content);
+        END;
+      SQL
+      @db.execute <<~SQL
+        CREATE TRIGGER IF NOT EXISTS #{@table}_fts_update AFTER UPDATE OF content ON #{@table} BEGIN
+          INSERT INTO #{@fts_table} (#{@fts_table}, rowid, content) VALUES ('delete', old.id, old.content);
+          INSERT INTO #{@fts_table} (rowid, content) VALUES (new.id, new.content);
+        END;
+      SQL
+      @db.execute("INSERT INTO #{@fts_table} (#{@fts_table}) VALUES ('rebuild')") if created
+      true
+    rescue SQLite3::SQLException
+      false
+    end
+
+    # [BM25 ranking, vector ranking], each [[id, score], ...] best first
+    def hybrid_rankings(text, query_obj, candidates, where)
+      return [lexical_ranking(text, candidates, where), vector_ranking(query_obj, candidates, where)] unless @indexed
+
+      index = @index
+      return [lexical_ranking(text, candidates, where), []] unless index
+
+      filter = filter_bitmap(where) if where
+      if index.size * index.dim >= CONCURRENT_SCAN_VALUES
+        # The scan runs without the GVL while this thread queries FTS5
+        semantic = Thread.new { index.search(query_obj, candidates, filter:) }
+        [lexical_ranking(text, candidates, where), semantic.value]
+      else
+        [lexical_ranking(text, candidates, where), index.search(query_obj, candidates, filter:)]
+      end
+    end
+
+    # BM25 ranking of the rows matching any word of the text
+    def lexical_ranking(text, candidates, where)
+      phrases = text.to_s.split.grep(/[[:alnum:]]/).map { |word| "\"#{word.gsub('"', '""')}\"" }
+      return [] if phrases.empty?
+
+      sql = "SELECT rowid, bm25(#{@fts_table}) FROM #{@fts_table} WHERE #{@fts_table} MATCH ?"
+      binds = [phrases.join(" OR ")]
+      if where
+        condition, filter_binds = filter_sql(where)
+        sql += " AND rowid IN (SELECT id FROM #{@table} WHERE #{condition})"
+        binds.concat(filter_binds)
+      end
+      # bm25() is lower for better matches
+      @db.execute("#{sql} ORDER BY bm25(#{@fts_table}) LIMIT ?", binds + [candidates]).map { |id, rank| [id, -rank] }
+    end
+
+    # The n best [[id, similarity], ...] through the index or the SQLite scan
+    def nearest(query_obj, n, where)
+      return vector_ranking(query_obj, n, where) unless @indexed
+
+      index = @index
+      return [] unless index
+
+      index.search(query_obj, n, filter: where && filter_bitmap(where))
+    end
+
+    # Vector ranking through the SQLite scan
+    def vector_ranking(query_obj, candidates, where)
+      topk = RagEmbeddings::TopK.new(query_obj, candidates, metric: @metric)
+      @db.execute(*scan_query(where)) { |id, blob| topk.push_packed(id, blob) }
+      RagEmbeddings.metrics.increment(:scanned_rows_total, topk.stats[:rows_scanned])
+      topk.results
+    end
+
+    # Packs a vector for the embedding column. A named collection takes the
+    # dimension of its first row and rejects the others.
+    def pack(embedding)
+      if @registry_id
+        if @dim.nil?
+          @dim = embedding.size
+          @db.execute("UPDATE collections SET dim = ? WHERE id = ?", [@dim, @registry_id])
+        elsif embedding.size != @dim
+          raise ArgumentError, "Collection #{@name} has #{@dim} dimensions, got #{embedding.size}"
+        end
+      end
+      embedding.pack(@pack)
+    end
+
+    # Values of the metadata columns, in METADATA_COLUMNS order
+    def metadata_values(metadata)
+      unknown = metadata.keys - METADATA
+      raise ArgumentError, "unknown metadata: #{unknown.join(", ")}" unless unknown.empty?
+
+      now = Time.now.to_i
+      [
+        metadata[:tenant_id],
+        metadata[:doc_id],
+        timestamp(metadata.fetch(:created_at, now)),
+        timestamp(metadata.fetch(:updated_at, now))
+      ]
+    end
+
+    # Hashes the content of the existing rows, so :exact also finds them.
+    # Reads them a page at a time, so the table never has to fit in memory.
+    def add_content_hashes
+      @db.execute("ALTER TABLE #{@table} ADD COLUMN content_hash BLOB")
+      @db.transaction do
+        last_id = 0
+        loop do
+          page = @db.execute("SELECT id, content FROM #{@table} WHERE id > ? ORDER BY id LIMIT 1000", [last_id])
+          break if page.empty?
+
+          page.each do |id, content|
+            @db.execute("UPDATE #{@table} SET content_hash = ? WHERE id = ?", [content_hash(content), id])
+          end
+          last_id = page.last.first
+        end
+      end
+    end
+
+    def content_hash(text)
+      Digest::SHA256.digest(text)
+    end
+
+    def row_binds(text, blob, values, dedup)
+      hash = content_hash(text)
+      binds = [text, blob, hash, *values]
+      binds << hash if dedup == :exact
+      binds
+    end
+
+    def check_dedup(dedup)
+      return if dedup.nil? || DEDUP_MODES.include?(dedup)
+
+      raise ArgumentError, "unknown dedup mode: #{dedup.inspect} (expected :exact or :near)"
+    end
+
+    # Whether an indexed row is at least threshold similar to the embedding
+    def near_duplicate?(embedding, threshold)
+      similar?(@index&.search(query_embedding(embedding), 1)&.first, threshold)
+    end
+
+    # For each query, whether a stored row is at least threshold similar: one
+    # batched scan of the index, or of the table loaded once
+    def stored_near_duplicates(queries, threshold)
+      store = @indexed ? @index : vector_store
+      return Array.new(queries.size, false) unless store && !queries.empty?
+
+      store.search_batch(queries, 1).map { |hits| similar?(hits.first, threshold) }
+    end
+
+    def similar?(hit, threshold)
+      !hit.nil? && hit.last >= threshold
+    end
+
+    def count_inserts(written, skipped)
+      RagEmbeddings.metrics.increment(:inserted_rows_total, written) if written.positive?
+      RagEmbeddings.metrics.increment(:deduplicated_rows_total, skipped) if skipped.positive?
+    end
+
+    def insert_tags(id, tags)
+      Array(tags).each do |tag|
+        @db.execute("INSERT OR IGNORE INTO #{@tags_table} (tag, embedding_id) VALUES (?, ?)", [tag.to_s, id])
+      end
+    end
+
+    def timestamp(value)
+      value.nil? ? nil : value.to_i
+    end
+
+    # SQL condition and binds selecting the rows that match a where: Hash
+    def filter_sql(where)
+      clauses = []
+      binds = []
+      where.each do |key, value|
+        case key
+        when :tenant_id, :doc_id
+          values = Array(value)
+          clauses << "#{key} IN (#{Array.new(values.size, "?").join(", ")})"
+          binds.concat(values)
+        when :tags
+          Array(value).each do |tag|
+            clauses << "id IN (SELECT embedding_id FROM #{@tags_table} WHERE tag = ?)"
+            binds << tag.to_s
+          end
+        when :created_at, :updated_at
+          if value.is_a?(Range)
+            if value.begin
+              clauses << "#{key} >= ?"
+              binds << timestamp(value.begin)
+            end
+            if value.end
+              clauses << "#{key} #{value.exclude_end? ? "<" : "<="} ?"
+              binds << timestamp(value.end)
+            end
+          else
+            clauses << "#{key} = ?"
+            binds << timestamp(value)
+          end
+        else
+          raise ArgumentError, "unknown filter: #{key}"
+        end
+      end
+      [clauses.empty? ? "1" : clauses.join(" AND "), binds]
+    end
+
+    # Query streaming the (id, embedding) pairs a search has to score
+    def scan_query(where)
+      return ["SELECT id, embedding FROM #{@table}", []] unless where
+
+      condition, binds = filter_sql(where)
+      ["SELECT id, embedding FROM #{@table} WHERE #{condition}", binds]
+    end
+
+    # Ids of the rows matching a where: Hash, as a native set for VectorStore#search
+    def filter_bitmap(where)
+      condition, binds = filter_sql(where)
+      bitmap = RagEmbeddings::Bitmap.new
+      @db.execute("SELECT id FROM #{@table} WHERE #{condition} ORDER BY id", binds) { |row| bitmap << row[0] }
+      bitmap
+    end
+
+    def index_add(id, blob)
+      return unless @indexed
+
+      @index ||= RagEmbeddings::VectorStore.new(blob.bytesize / 4, metric: @metric)
+      @index.add_packed(id, blob)
+    end
+
+    def indexed_top_k_similar(query, k, stats, where)
+      index = @index # snapshot: a concurrent reload_index swaps the ivar, not this store
+      stats ||= RagEmbeddings::SearchStats.new
+      stats.backend = "memory index"
+      stats.measure(:total_time) do
+        query_obj = stats.measure(:embed_time) { query_embedding(query) }
+        filter = stats.measure(:read_time) { filter_bitmap(where) } if where
+        native = {}
+        hits = index ? index.search(query_obj, k, native, filter:) : []
+        stats.merge!(native)
+        RagEmbeddings.metrics.increment(:scanned_rows_total, native.fetch(:rows_scanned, 0))
+        stats.measure(:fetch_time) { with_contents(hits) }
+      end
+    end
+
+    def timed_top_k_similar(query, k, stats, where)
+      stats.backend = "sqlite scan"
+      stats.measure(:total_time) do
+        query_obj = stats.measure(:embed_time) { query_embedding(query) }
+        topk = RagEmbeddings::TopK.new(query_obj, k, true, metric: @metric)
+        stats.measure(:read_time) do
+          @db.execute(*scan_query(where)) { |id, blob| topk.push_packed(id, blob) }
+        end
+        hits = topk.results
+        native = topk.stats
+        stats.merge!(native)
+        RagEmbeddings.metrics.increment(:scanned_rows_total, native[:rows_scanned])
+        # read_time measured the whole cursor loop, keep only the SQLite part
+        stats.read_time -= native[:decode_time] + native[:scoring_time] + native[:heap_time]
+        stats.measure(:fetch_time) { with_contents(hits) }
+      end
+    end
+
+    # Turns [[id, similarity], ...] into [[id, content, similarity], ...]
+    def with_contents(hits)
+      return [] if hits.empty?
+
+      contents = column_for("content", hits.map(&:first))
+      hits.map { |id, similarity| [id, contents[id], similarity] }
+    end
+
+    # { id => value of column } for the rows that exist, in slices that stay
+    # under the SQLite variable limit
+    def column_for(column, ids)
+      ids.each_slice(CONTENT_SLICE).each_with_object({}) do |slice, values|
+        placeholders = Array.new(slice.size, "?").join(", ")
+        values.merge!(@db.execute("SELECT id, #{column} FROM #{@table} WHERE id IN (#{placeholders})", slice).to_h)
+      end
+    end
+
+    def query_embedding(query)
+      embedding =
+        case query
+        when RagEmbeddings::Embedding then query
+        when Array then RagEmbeddings::Embedding.from_array(query)
+        else RagEmbeddings::Embedding.from_array(RagEmbeddings.embed(query))
+        end
+      if @dim && embedding.dim != @dim
+        raise ArgumentError, "Collection #{@name} has #{@dim} dimensions, the query has #{embedding.dim}"
+      end
+
+      embedding
+    end
+  end
+end
@@ -1,39 +1,101 @@
+require "forwardable"
 require "sqlite3"
 
 module RagEmbeddings
+  # A SQLite file of embeddings. The database is itself a collection (the
+  # legacy embeddings table) and holds named collections, each with its own
+  # dimension, dtype, metric and table:
+  #
+  #   db = RagEmbeddings::Database.new("embeddings.db")
+  #   small = db.collection("articles", dim: 768)
+  #   large = db.collection("code", dim: 3072, metric: :dot, index: true)
   class Database
-    def initialize(path = "embeddings.db")
+    extend Forwardable
+
+    def_delegators :@default, :insert, :insert_many, :delete, :delete_many, :reload_index, :indexed?,
+                   :all, :embeddings, :vector_store, :top_k_similar, :explain, :hybrid_search, :mmr_search, :search_batch
+
+    # See Collection#initialize for index:, which is also the default of the
+    # collections opened from this database
+    def initialize(path = "embeddings.db", index: false)
       @db = SQLite3::Database.new(path)
       @db.execute <<~SQL
-        CREATE TABLE IF NOT EXISTS embeddings (
+        CREATE TABLE IF NOT EXISTS collections (
           id INTEGER PRIMARY KEY AUTOINCREMENT,
-          content TEXT NOT NULL,
-          embedding BLOB NOT NULL
+          name TEXT NOT NULL UNIQUE,
+          dim INTEGER,
+          dtype TEXT NOT NULL,
+          metric TEXT NOT NULL
         );
       SQL
+      @write_lock = Mutex.new
+      @index = index
+      @collections = {}
+      @default = Collection.new(@db, table: "embeddings", tags_table: "embedding_tags", write_lock: @write_lock, index:)
+    end
+
+    # Returns the collection with this name, creating it on first use.
+    # dim: is taken from the first row when not given; dtype: (:float32)
+    # and metric: (:cosine or :dot) are fixed at creation, and raise
+    # ArgumentError when they contradict an existing collection.
+    def collection(name, dim: nil, dtype: nil, metric: nil, index: @index)
+      name = name.to_s
+      @write_lock.synchronize do
+        collection = @collections[name] ||= open_collection(name, dim, dtype, metric, index)
+        # dtype: and metric: may be given as Strings, as on creation
+        { dim:, dtype: dtype&.to_sym, metric: metric&.to_sym }.each do |option, value|
+          next if value.nil? || collection.public_send(option).nil? || collection.public_send(option) == value
+
+          raise ArgumentError, "Collection #{name} has #{option} #{collection.public_send(option)}, not #{value}"
+        end
+        collection
+      end
     end
 
-    def insert(text, embedding)
-      blob = embedding.pack("f*")
-      @db.execute("INSERT INTO embeddings (content, embedding) VALUES (?, ?)", [text, blob])
+    # Names of the named collections
+    def collections
+      @db.execute("SELECT name FROM collections ORDER BY name").map(&:first)
     end
 
-    def all
-      @db.execute("SELECT id, content, embedding FROM embeddings").map do |id, content, blob|
-        [id, content, blob.unpack("f*")]
+    # Deletes a named collection and its rows; returns true if it existed
+    def drop_collection(name)
+      name = name.to_s
+      @write_lock.synchronize do
+        id = @db.execute("SELECT id FROM collections WHERE name = ?", [name]).first&.first
+        next false unless id
+
+        @db.transaction do
+          @db.execute("DROP TABLE IF EXISTS collection_#{id}")
+          @db.execute("DROP TABLE IF EXISTS collection_#{id}_tags")
+          @db.execute("DROP TABLE IF EXISTS collection_#{id}_fts")
+          @db.execute("DELETE FROM collections WHERE id = ?", [id])
+        end
+        @collections.delete(name)
+        true
       end
     end
 
-    # "Raw" search: returns the N texts most similar to the query
-    def top_k_similar(query_text, k: 5)
-      query_embedding = RagEmbeddings.embed(query_text)
-      query_obj = RagEmbeddings::Embedding.from_array(query_embedding)
+    def close
+      @db.close
+    end
+
+    private
 
-      all.map do |id, content, emb|
-        emb_obj = RagEmbeddings::Embedding.from_array(emb)
-        similarity = emb_obj.cosine_similarity(query_obj)
-        [id, content, similarity]
-      end.sort_by { |_,_,sim| -sim }.first(k)
+    def open_collection(name, dim, dtype, metric, index)
+      row = @db.execute("SELECT id, dim, dtype, metric FROM collections WHERE name = ?", [name]).first
+      unless row
+        dtype = (dtype || :float32).to_sym
+        metric = (metric || :cosine).to_sym
+        raise ArgumentError, "unknown dtype: #{dtype}" unless Collection::DTYPES.key?(dtype)
+        raise ArgumentError, "unknown metric: #{metric}" unless Collection::METRICS.include?(metric)
+
+        @db.execute("INSERT INTO collections (name, dim, dtype, metric) VALUES (?, ?, ?, ?)",
+                    [name, dim, dtype.to_s, metric.to_s])
+        row = [@db.last_insert_row_id, dim, dtype.to_s, metric.to_s]
+      end
+      id, dim, dtype, metric = row
+      Collection.new(@db, table: "collection_#{id}", tags_table: "collection_#{id}_tags", write_lock: @write_lock,
+                          name:, registry_id: id, dim:, dtype: dtype.to_sym, metric: metric.to_sym, index:)
     end
   end
 end
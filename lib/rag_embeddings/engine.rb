@@ -14,7 +14,25 @@ module RagEmbeddings
     )
   end
 
+  # The embedding provider used by embed and embed_batch, Ollama by default.
+  # Any object responding to embed(text, model:) and embed_batch(texts, model:) works,
+  # see RagEmbeddings::Providers::Base.
+  def self.provider
+    @provider ||= Providers::Ollama.new
+  end
+
+  def self.provider=(provider)
+    @provider = provider
+  end
+
   def self.embed(text, model: DEFAULT_MODEL)
-    llm(model:).embed(text:).embedding
+    metrics.increment(:embedded_texts_total)
+    metrics.time(:embed_duration_seconds) { provider.embed(text, model:) }
+  end
+
+  # Embeds a list of texts, returning one float array per text in the same order
+  def self.embed_batch(texts, model: DEFAULT_MODEL)
+    metrics.increment(:embedded_texts_total, texts.size)
+    metrics.time(:embed_duration_seconds) { provider.embed_batch(texts, model:) }
   end
 end
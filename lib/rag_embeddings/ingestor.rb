@@ -0,0 +1,180 @@
+module RagEmbeddings
+  # Indexes a set of files by running four stages concurrently:
+  #
+  #   read -> chunk -> embed -> insert
+  #
+  # Stages are connected by bounded queues, so a slow stage (usually embed)
+  # applies backpressure upstream and memory stays flat however many files
+  # are fed in. Each stage keeps its own counters, returned by #run.
+  #
+  #   ingestor = RagEmbeddings::Ingestor.new(db, batch_size: 32, embed_workers: 4)
+  #   stats = ingestor.run(Dir["./docs/**/*.txt"])
+  #   stats[:embed][:items_per_second] # => 41.7
+  class Ingestor
+    STAGES = %i[read chunk embed insert].freeze
+
+    # Per-stage counters. +busy+ is the time spent working, excluding the
+    # time spent blocked on the neighbouring queues.
+    class StageStats
+      attr_reader :name, :items, :bytes, :busy
+
+      def initialize(name)
+        @name = name
+        @items = 0
+        @bytes = 0
+        @busy = 0.0
+        @lock = Mutex.new
+      end
+
+      def measure(items: 1, bytes: 0)
+        started = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+        result = yield
+        busy = Process.clock_gettime(Process::CLOCK_MONOTONIC) - started
+        @lock.synchronize do
+          @busy += busy
+          @items += items
+          @bytes += bytes
+        end
+        result
+      end
+
+      def to_h(elapsed)
+        {
+          items: @items,
+          bytes: @bytes,
+          busy_seconds: @busy.round(6),
+          items_per_second: elapsed.positive? ? (@items / elapsed).round(2) : 0.0,
+          bytes_per_second: elapsed.positive? ? (@bytes / elapsed).round(2) : 0.0
+        }
+      end
+    end
+
+    attr_reader :stats
+
+    # db            - RagEmbeddings::Database receiving the rows
+    # batch_size    - chunks per embed call and per insert transaction
+    # queue_size    - capacity of each queue between stages, in items
+    # embed_workers - concurrent embed calls (the network stage is usually the bottleneck)
+    # chunker       - callable returning the chunks of a text, see RagEmbeddings::Chunker
+    # model         - model passed to RagEmbeddings.embed_batch
+    # dedup         - dedup: mode of Database#insert_many (:exact, :near or nil),
+    #                 so re-running an ingestion does not duplicate the rows
+    def initialize(db, batch_size: 32, queue_size: 8, embed_workers: 2,
+                   chunker: Chunker.new, model: DEFAULT_MODEL, dedup: nil)
+      raise ArgumentError, "batch_size must be positive" unless batch_size.positive?
+      raise ArgumentError, "queue_size must be positive" unless queue_size.positive?
+      raise ArgumentError, "embed_workers must be positive" unless embed_workers.positive?
+
+      @db = db
+      @batch_size = batch_size
+      @queue_size = queue_size
+      @embed_workers = embed_workers
+      @chunker = chunker
+      @model = model
+      @dedup = dedup
+    end
+
+    # Runs the pipeline over +paths+ and returns the per-stage throughput:
+    #
+    #   { elapsed: 12.3, read: { items:, bytes:, busy_seconds:, items_per_second:, bytes_per_second: }, ... }
+    #
+    # The first error raised by any stage stops the pipeline and is re-raised here.
+    def run(paths)
+      @stats = STAGES.to_h { |name| [name, StageStats.new(name)] }
+      @error = nil
+      files = SizedQueue.new(@queue_size)
+      batches = SizedQueue.new(@queue_size)
+      embedded = SizedQueue.new(@queue_size)
+      queues = [files, batches, embedded]
+
+      started = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+
+      threads = []
+      threads << stage(queues, files) { read(paths, files) }
+      threads << stage(queues, batches) { chunk(files, batches) }
+      embedders = Array.new(@embed_workers) { stage(queues) { embed(batches, embedded) } }
+      threads.concat(embedders)
+      threads << Thread.new do
+        embedders.each(&:join)
+        embedded.close
+      end
+      threads << stage(queues) { insert(embedded) }
+      threads.each(&:join)
+
+      raise @error if @error
+
+      elapsed = Process.clock_gettime(Process::CLOCK_MONOTONIC) - started
+      @stats.transform_values { |stage_stats| stage_stats.to_h(elapsed) }.merge(elapsed: elapsed.round(6))
+    end
+
+    private
+
+    # Runs a stage in its own thread, closing +output+ when it finishes.
+    # Any error aborts the whole pipeline: every queue is closed, which
+    # unblocks the other stages, and emptied, and the stages check for the
+    # error before each item, so no more work is done once a stage failed.
+    def stage(queues, output = nil)
+      Thread.new do
+        yield
+      rescue ClosedQueueError
+        # Another stage failed and closed the queues
+      rescue Exception => e # rubocop:disable Lint/RescueException
+        @error ||= e
+        queues.each do |queue|
+          queue.close
+          queue.clear
+        end
+      ensure
+        output&.close
+      end
+    end
+
+    # Next item of a queue, or nil once it is drained or the pipeline failed
+    def take(queue)
+      item = queue.pop
+      item unless @error
+    end
+
+    def read(paths, files)
+      read_stats = @stats[:read]
+      paths.each do |path|
+        break if @error
+
+        files << read_stats.measure(bytes: File.size(path)) { File.read(path, encoding: "UTF-8") }
+      end
+    end
+
+    def chunk(files, batches)
+      chunk_stats = @stats[:chunk]
+      batch = []
+      while (text = take(files))
+        chunks = chunk_stats.measure(bytes: text.bytesize) { @chunker.call(text) }
+        chunks.each do |chunk|
+          batch << chunk
+          next if batch.size < @batch_size
+
+          batches << batch
+          batch = []
+        end
+      end
+      batches << batch unless batch.empty?
+    end
+
+    def embed(batches, embedded)
+      embed_stats = @stats[:embed]
+      while (batch = take(batches))
+        vectors = embed_stats.measure(items: batch.size, bytes: batch.sum(&:bytesize)) do
+          RagEmbeddings.embed_batch(batch, model: @model)
+        end
+        embedded << batch.zip(vectors)
+      end
+    end
+
+    def insert(embedded)
+      insert_stats = @stats[:insert]
+      while (rows = take(embedded))
+        insert_stats.measure(items: rows.size) { @db.insert_many(rows, dedup: @dedup) }
+      end
+    end
+  end
+end
@@ -0,0 +1,154 @@
+module RagEmbeddings
+  # Process-wide registry of latency histograms, counters and gauges.
+  # The library records embed, insert and search latencies and throughput
+  # into RagEmbeddings.metrics; gauges are read when a snapshot is taken.
+  #
+  #   RagEmbeddings.metrics.snapshot[:search_duration_seconds][:p99]
+  #   RagEmbeddings.metrics.write_prometheus("/var/lib/node_exporter/rag_embeddings.prom")
+  #
+  # Histograms are RagEmbeddings::Histogram (log-linear buckets in C), so
+  # recording costs no allocation and the tail quantiles are within ~3%.
+  class Metrics
+    PREFIX = "rag_embeddings_".freeze
+    QUANTILES = { 0.5 => :p50, 0.9 => :p90, 0.95 => :p95, 0.99 => :p99, 0.999 => :p999 }.freeze
+
+    Metric = Struct.new(:name, :type, :help, :value)
+
+    def initialize
+      @metrics = {}
+      @lock = Mutex.new
+    end
+
+    def histogram(name, help)
+      register(name, :summary, help) { Histogram.new }
+    end
+
+    def counter(name, help)
+      register(name, :counter, help) { 0 }
+    end
+
+    # The block is called for the current value every time a snapshot is taken
+    def gauge(name, help, &block)
+      register(name, :gauge, help) { block }
+    end
+
+    # Records the duration of the block in the +name+ histogram
+    def time(name)
+      started = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+      yield
+    ensure
+      observe(name, Process.clock_gettime(Process::CLOCK_MONOTONIC) - started)
+    end
+
+    def observe(name, seconds)
+      @lock.synchronize { fetch(name, :summary).value.record(seconds) }
+    end
+
+    def increment(name, by = 1)
+      @lock.synchronize { fetch(name, :counter).value += by }
+    end
+
+    # Current values: counters and gauges as numbers, histograms as
+    # { count:, sum:, min:, max:, p50:, p90:, p95:, p99:, p999: } in seconds
+    def snapshot
+      @lock.synchronize do
+        @metrics.transform_values do |metric|
+          case metric.type
+          when :summary then summarize(metric.value)
+          when :gauge then metric.value.call
+          else metric.value
+          end
+        end
+      end
+    end
+
+    # Clears the histograms and counters (gauges are computed on demand)
+    def reset
+      @lock.synchronize do
+        @metrics.each_value do |metric|
+          case metric.type
+          when :summary then metric.value.reset
+          when :counter then metric.value = 0
+          end
+        end
+      end
+      self
+    end
+
+    # Renders the metrics in the Prometheus text exposition format.
+    # Histograms are exported as summaries with precomputed quantiles.
+    def to_prometheus
+      values = snapshot
+      lines = []
+      @metrics.each_value do |metric|
+        name = "#{PREFIX}#{metric.name}"
+        value = values[metric.name]
+        lines << "# HELP #{name} #{metric.help}"
+        lines << "# TYPE #{name} #{metric.type}"
+        if metric.type == :summary
+          QUANTILES.each { |q, key| lines << "#{name}{quantile=\"#{q}\"} #{value[key]}" }
+          lines << "#{name}_sum #{value[:sum]}"
+          lines << "#{name}_count #{value[:count]}"
+        else
+          lines << "#{name} #{value}"
+        end
+      end
+      lines.join("\n") << "\n"
+    end
+
+    # Writes #to_prometheus to an IO, or atomically to a file path
+    # (for the node_exporter textfile collector)
+    def write_prometheus(target)
+      return target.write(to_prometheus) if target.respond_to?(:write)
+
+      tmp = "#{target}.#{Process.pid}.tmp"
+      File.write(tmp, to_prometheus)
+      File.rename(tmp, target)
+    end
+
+    private
+
+    def register(name, type, help)
+      @lock.synchronize do
+        @metrics[name] ||= Metric.new(name, type, help, yield)
+      end
+    end
+
+    def fetch(name, type)
+      metric = @metrics.fetch(name) { raise ArgumentError, "Unknown metric #{name}" }
+      raise ArgumentError, "#{name} is a #{metric.type}, not a #{type}" unless metric.type == type
+
+      metric
+    end
+
+    def summarize(histogram)
+      QUANTILES.to_h { |q, key| [key, histogram.percentile(q)] }
+        .merge(count: histogram.count, sum: histogram.sum, min: histogram.min, max: histogram.max)
+    end
+  end
+
+  # The process-wide registry, with the metrics recorded by the library
+  def self.metrics
+    @metrics || METRICS_LOCK.synchronize do
+      @metrics ||= Metrics.new.tap do |metrics|
+        metrics.histogram(:embed_duration_seconds, "Time to embed one text or one batch of texts")
+        metrics.counter(:embedded_texts_total, "Texts embedded")
+        metrics.histogram(:insert_duration_seconds, "Time of Database#insert and #insert_many calls")
+        metrics.counter(:inserted_rows_total, "Rows inserted into a Database")
+        metrics.counter(:deduplicated_rows_total, "Rows skipped by inserts with dedup:")
+        metrics.histogram(:search_duration_seconds, "Time of Database searches: top_k_similar, search_batch, mmr_search and hybrid_search calls")
+        metrics.counter(:searches_total, "Database searches")
+        metrics.counter(:scanned_rows_total, "Rows scored by Database searches")
+        metrics.counter(:search_batches_total, "Batched scans run by BatchScheduler")
+        metrics.counter(:batched_searches_total, "Searches answered by BatchScheduler batches")
+        metrics.gauge(:vector_stores, "Live native VectorStore objects") { VectorStore.memory_stats[:stores] }
+        metrics.gauge(:vector_store_rows, "Rows held by live native VectorStore objects") { VectorStore.memory_stats[:rows] }
+        metrics.gauge(:vector_store_bytes, "Memory allocated by live native VectorStore objects") { VectorStore.memory_stats[:bytes] }
+        metrics.gauge(:vector_store_mapped_bytes, "Store files mapped by VectorStore.map") { VectorStore.memory_stats[:mapped_bytes] }
+      end
+    end
+  end
+
+  METRICS_LOCK = Mutex.new
+  private_constant :METRICS_LOCK
+end
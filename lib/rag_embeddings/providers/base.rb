@@ -0,0 +1,18 @@
+module RagEmbeddings
+  module Providers
+    # Interface of an embedding provider. A provider only has to implement
+    # #embed; override #embed_batch when the backend can embed many texts
+    # in one call.
+    class Base
+      # Returns the embedding of +text+ as an array of floats
+      def embed(text, model: nil)
+        raise NotImplementedError, "#{self.class} must implement #embed"
+      end
+
+      # Returns one embedding per text, in the same order
+      def embed_batch(texts, model: nil)
+        texts.map { |text| embed(text, model:) }
+      end
+    end
+  end
+end
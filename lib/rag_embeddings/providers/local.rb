@@ -0,0 +1,24 @@
+module RagEmbeddings
+  module Providers
+    # Deterministic offline embeddings computed in C with the hashing trick
+    # (see ext/rag_embeddings/feature_hash.c). The same text, dimension and
+    # seed always give the same vector, and texts sharing words are similar.
+    # Meant for tests, CI and load tests, not for semantic quality.
+    #
+    #   RagEmbeddings.provider = RagEmbeddings::Providers::Local.new(dim: 768)
+    class Local < Base
+      attr_reader :dim, :seed, :ngram
+
+      def initialize(dim: 768, seed: 0, ngram: 2)
+        @dim = dim
+        @seed = seed
+        @ngram = ngram
+      end
+
+      # The model is ignored: the vector only depends on text, dim, seed and ngram
+      def embed(text, model: nil)
+        Embedding.feature_hash(text, @dim, @seed, @ngram).to_a
+      end
+    end
+  end
+end
@@ -0,0 +1,10 @@
+module RagEmbeddings
+  module Providers
+    # Embeddings from a local Ollama server through langchainrb (the default provider)
+    class Ollama < Base
+      def embed(text, model: DEFAULT_MODEL)
+        RagEmbeddings.llm(model:).embed(text:).embedding
+      end
+    end
+  end
+end
@@ -0,0 +1,55 @@
+module RagEmbeddings
+  # Where the time of one search went. Pass an instance as the stats: option
+  # of Database#top_k_similar to have it filled, or call Database#explain.
+  #
+  #   stats = RagEmbeddings::SearchStats.new
+  #   db.top_k_similar("query", k: 5, stats:)
+  #   puts stats
+  #
+  # Times are in seconds. Counters and phases that a backend does not have
+  # (e.g. candidates_reranked for an exact scan) stay at 0.
+  class SearchStats
+    COUNTERS = %i[rows_scanned bytes_read candidates_reranked].freeze
+    TIMINGS = %i[embed_time read_time decode_time scoring_time heap_time fetch_time total_time].freeze
+
+    attr_accessor :backend, *COUNTERS, *TIMINGS
+
+    def initialize
+      @backend = nil
+      (COUNTERS + TIMINGS).each { |field| public_send(:"#{field}=", 0) }
+      TIMINGS.each { |field| public_send(:"#{field}=", 0.0) }
+    end
+
+    # Runs the block and adds its duration to the +field+ timing
+    def measure(field)
+      started = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+      result = yield
+      public_send(:"#{field}=", public_send(field) + Process.clock_gettime(Process::CLOCK_MONOTONIC) - started)
+      result
+    end
+
+    # Adds the counters and timings reported by the native search code
+    # (TopK#stats, VectorStore#search) to this object
+    def merge!(native)
+      native.each do |field, value|
+        field = :bytes_read if field == :bytes
+        next unless respond_to?(:"#{field}=")
+
+        public_send(:"#{field}=", public_send(field) + value)
+      end
+      self
+    end
+
+    def to_h
+      { backend: }.merge((COUNTERS + TIMINGS).to_h { |field| [field, public_send(field)] })
+    end
+
+    # Human readable breakdown, one phase per line
+    def to_s
+      lines = ["backend: #{backend}"]
+      COUNTERS.each { |field| lines << format("%-20s %d", "#{field}:", public_send(field)) }
+      TIMINGS.each { |field| lines << format("%-20s %.3f ms", "#{field}:", public_send(field) * 1000.0) }
+      lines.join("\n")
+    end
+  end
+end
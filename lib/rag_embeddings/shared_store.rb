@@ -0,0 +1,87 @@
+module RagEmbeddings
+  # Read-only VectorStore shared by the processes of a pre-forking server.
+  #
+  # The master publishes a store file, and every worker maps the same file
+  # with VectorStore.map (MAP_SHARED), so the rows are in memory once for
+  # all the workers. To reindex, the master publishes a new generation:
+  # VectorStore#save writes a temporary file and renames it over the path.
+  # Workers notice the new file (checked at most every check_interval
+  # seconds) and map it for their next search. Searches already running
+  # finish on the old mapping.
+  #
+  #   # config/puma.rb
+  #   before_fork do
+  #     RagEmbeddings::SharedStore.publish(RagEmbeddings::Database.new("embeddings.db").vector_store, "tmp/embeddings.store")
+  #   end
+  #
+  #   # in the app
+  #   STORE = RagEmbeddings::SharedStore.new("tmp/embeddings.store")
+  #   STORE.search(query_embedding, 5) # => [[id, similarity], ...]
+  class SharedStore
+    # Writes the store as the new generation of the file at path
+    def self.publish(store, path)
+      if store.nil?
+        raise ArgumentError, "Nothing to publish: the store is nil (Database#vector_store of an empty table without a dim)"
+      end
+
+      store.save(path)
+    end
+
+    attr_reader :path, :generation
+
+    def initialize(path, check_interval: 1.0)
+      @path = path
+      @check_interval = check_interval
+      @mutex = Mutex.new
+      @generation = 0
+      reload
+    end
+
+    # The mapped VectorStore of the current generation
+    def store
+      refresh if now - @checked_at >= @check_interval
+      @store
+    end
+
+    def search(query, k = 10, stats = nil)
+      store.search(query, k, stats)
+    end
+
+    def search_batch(queries, k = 10)
+      store.search_batch(queries, k)
+    end
+
+    def size
+      store.size
+    end
+
+    def dim
+      store.dim
+    end
+
+    private
+
+    def now
+      Process.clock_gettime(Process::CLOCK_MONOTONIC)
+    end
+
+    # A new generation is a new file (rename), hence a new inode
+    def refresh
+      @mutex.synchronize do
+        next if now - @checked_at < @check_interval
+
+        @checked_at = now
+        stat = File.stat(@path)
+        reload if [stat.dev, stat.ino] != @file_id
+      end
+    end
+
+    def reload
+      stat = File.stat(@path)
+      @store = VectorStore.map(@path)
+      @file_id = [stat.dev, stat.ino]
+      @generation += 1
+      @checked_at = now
+    end
+  end
+end
@@ -0,0 +1,25 @@
+require "spec_helper"
+require "rag_embeddings"
+
+RSpec.describe RagEmbeddings::Bitmap do
+  it "holds a set of 64-bit ids" do
+    bitmap = described_class.new([70_000, 3, 5, 3, -2])
+
+    expect(bitmap.size).to eq 4
+    expect(bitmap.to_a).to eq [-2, 3, 5, 70_000]
+    expect(bitmap).to include(5)
+    expect(bitmap).not_to include(4)
+    expect(described_class.new).to be_empty
+  end
+
+  it "switches dense containers to bitsets without losing ids" do
+    bitmap = described_class.new
+    ids = (0...10_000).map { |i| i * 3 }
+    ids.each { |id| bitmap << id }
+    bitmap << 1
+
+    expect(bitmap.size).to eq 10_001
+    expect(bitmap.to_a).to eq ([1] + ids).sort
+    expect(bitmap).not_to include(2)
+  end
+end
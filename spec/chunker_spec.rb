@@ -0,0 +1,45 @@
+require "spec_helper"
+require "rag_embeddings"
+
+RSpec.describe RagEmbeddings::Chunker do
+  let(:text) do
+    "First sentence here. Second one is a bit longer!\n\n" \
+      "New paragraph starts. Ünïcödé wörds ärë hérè 日本語の文です。次の文。 end."
+  end
+
+  it "returns byte offsets of chunks no larger than max_bytes" do
+    chunker = described_class.new(max_bytes: 60, overlap: 15)
+    offsets = chunker.offsets(text)
+
+    expect(offsets.size).to be > 1
+    offsets.each do |offset, length|
+      expect(length).to be <= 60
+      expect(text.byteslice(offset, length)).to be_valid_encoding
+    end
+  end
+
+  it "prefers paragraph and sentence boundaries" do
+    chunks = described_class.new(max_bytes: 60, overlap: 0).split(text)
+    expect(chunks.first).to eq "First sentence here. Second one is a bit longer!"
+    expect(chunks[1]).to start_with "New paragraph starts."
+  end
+
+  it "overlaps consecutive chunks" do
+    offsets = described_class.new(max_bytes: 60, overlap: 15).offsets(text)
+    offsets.each_cons(2) do |(offset, length), (next_offset, _)|
+      expect(next_offset).to be < offset + length
+      expect(next_offset).to be > offset
+    end
+  end
+
+  it "returns a single chunk for short texts and none for blank ones" do
+    chunker = described_class.new
+    expect(chunker.split("  Short text.  ")).to eq ["Short text."]
+    expect(chunker.split(" \n ")).to eq []
+  end
+
+  it "validates its options" do
+    expect { described_class.new(max_bytes: 0) }.to raise_error(ArgumentError)
+    expect { described_class.new(max_bytes: 10, overlap: 10) }.to raise_error(ArgumentError)
+  end
+end
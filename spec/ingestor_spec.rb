@@ -0,0 +1,60 @@
+require "spec_helper"
+require "rag_embeddings"
+require "tmpdir"
+
+RSpec.describe RagEmbeddings::Ingestor do
+  let(:db_path) { "test_ingestor.db" }
+  let(:db) { RagEmbeddings::Database.new(db_path) }
+
+  before do
+    allow(RagEmbeddings).to receive(:embed_batch) do |texts, **|
+      texts.map { |text| [text.size.to_f, 1.0, 0.5] }
+    end
+  end
+
+  after(:each) { File.delete(db_path) if File.exist?(db_path) }
+
+  it "indexes every chunk of every file and reports per-stage throughput" do
+    Dir.mktmpdir do |dir|
+      paths = Array.new(20) do |i|
+        File.join(dir, "doc#{i}.txt").tap { |path| File.write(path, "first #{i}\n\nsecond #{i}") }
+      end
+
+      ingestor = described_class.new(db, batch_size: 3, queue_size: 1, embed_workers: 2,
+                                          chunker: ->(text) { text.split("\n\n") })
+      stats = ingestor.run(paths)
+
+      expect(db.all.size).to eq 40
+      expect(stats[:read][:items]).to eq 20
+      expect(stats[:embed][:items]).to eq 40
+      expect(stats[:insert][:items]).to eq 40
+      expect(stats[:embed][:items_per_second]).to be > 0
+    end
+  end
+
+  it "re-raises the first error of any stage" do
+    expect { described_class.new(db).run(["does/not/exist.txt"]) }.to raise_error(Errno::ENOENT)
+  end
+
+  it "stops every stage after the first error" do
+    calls = 0
+    allow(RagEmbeddings).to receive(:embed_batch) do |texts, **|
+      raise IOError, "provider down" if (calls += 1) == 6
+
+      texts.map { [1.0, 0.0, 0.0] }
+    end
+    # A slow insert stage, so embedded rows are still queued when embed fails
+    allow(db).to receive(:insert_many).and_wrap_original do |insert_many, *args, **options|
+      sleep 0.05
+      insert_many.call(*args, **options)
+    end
+
+    Dir.mktmpdir do |dir|
+      paths = Array.new(10) { |i| File.join(dir, "doc#{i}.txt").tap { |path| File.write(path, "doc #{i}") } }
+      ingestor = described_class.new(db, batch_size: 1, queue_size: 8, embed_workers: 1)
+
+      expect { ingestor.run(paths) }.to raise_error(IOError)
+      expect(db.all.size).to be <= 1 # only the insert already running when embed failed
+    end
+  end
+end
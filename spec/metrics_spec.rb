@@ -0,0 +1,41 @@
+require "spec_helper"
+require "rag_embeddings"
+require "stringio"
+
+RSpec.describe RagEmbeddings::Metrics do
+  subject(:metrics) { described_class.new }
+
+  it "keeps latency quantiles within a few percent" do
+    histogram = RagEmbeddings::Histogram.new
+    1.upto(10_000) { |i| histogram.record(i / 1_000_000.0) }
+
+    expect(histogram.count).to eq 10_000
+    expect(histogram.percentile(0.5)).to be_within(0.03 * 0.005).of(0.005)
+    expect(histogram.percentile(0.99)).to be_within(0.03 * 0.0099).of(0.0099)
+    expect(histogram.max).to be_within(1e-9).of(0.01)
+  end
+
+  it "records timings and counters and renders them for Prometheus" do
+    metrics.histogram(:search_duration_seconds, "Search time")
+    metrics.counter(:searches_total, "Searches")
+    metrics.gauge(:answer, "A gauge") { 42 }
+
+    3.times { metrics.time(:search_duration_seconds) { metrics.increment(:searches_total) } }
+
+    snapshot = metrics.snapshot
+    expect(snapshot[:searches_total]).to eq 3
+    expect(snapshot[:search_duration_seconds][:count]).to eq 3
+    expect(snapshot[:answer]).to eq 42
+
+    io = StringIO.new
+    metrics.write_prometheus(io)
+    expect(io.string).to include("# TYPE rag_embeddings_search_duration_seconds summary")
+    expect(io.string).to include("rag_embeddings_search_duration_seconds{quantile=\"0.99\"}")
+    expect(io.string).to include("rag_embeddings_searches_total 3")
+    expect(io.string).to include("rag_embeddings_answer 42")
+  end
+
+  it "exposes the library metrics process-wide" do
+    expect(RagEmbeddings.metrics.snapshot).to include(:embed_duration_seconds, :inserted_rows_total, :vector_store_bytes)
+  end
+end
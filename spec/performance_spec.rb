@@ -153,6 +153,18 @@ RSpec.describe "Performance" do
       GC.start
       after_release = get_memory_usage
       puts "After release: #{after_release[:rss_mb]} MB"
+
+      # Test 3: Same batch in a single arena
+      puts "Test 3: Bulk creation in one arena"
+      refs = RagEmbeddings::Embedding.from_arrays(Array.new(n, emb1))
+      with_arena = get_memory_usage
+      puts "With all references: #{with_arena[:rss_mb]} MB"
+
+      refs.clear
+      refs = nil
+      GC.start
+      after_arena_release = get_memory_usage
+      puts "After release: #{after_arena_release[:rss_mb]} MB"
     end
   end
 
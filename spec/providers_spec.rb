@@ -0,0 +1,32 @@
+require "spec_helper"
+require "rag_embeddings"
+
+RSpec.describe RagEmbeddings::Providers::Local do
+  subject(:provider) { described_class.new(dim: 256, seed: 42) }
+
+  it "returns stable normalized vectors of the requested dimension" do
+    embedding = provider.embed("The quick brown fox")
+
+    expect(embedding.size).to eq 256
+    expect(embedding).to eq provider.embed("the QUICK brown fox!")
+    expect(RagEmbeddings::Embedding.from_array(embedding).magnitude).to be_within(1e-6).of(1.0)
+  end
+
+  it "depends on the seed" do
+    expect(provider.embed("The quick brown fox")).not_to eq described_class.new(dim: 256, seed: 1).embed("The quick brown fox")
+  end
+
+  it "makes texts sharing words more similar than unrelated ones" do
+    query, related, unrelated = provider.embed_batch(["cats purr softly", "the cats purr", "stock markets fell"])
+      .map { |embedding| RagEmbeddings::Embedding.from_array(embedding) }
+
+    expect(query.cosine_similarity(related)).to be > query.cosine_similarity(unrelated)
+  end
+
+  it "can back RagEmbeddings.embed" do
+    RagEmbeddings.provider = provider
+    expect(RagEmbeddings.embed("offline")).to eq provider.embed("offline")
+  ensure
+    RagEmbeddings.provider = nil
+  end
+end
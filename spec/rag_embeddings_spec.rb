@@ -48,6 +48,37 @@ RSpec.describe RagEmbeddings do
   end
 
 
+  it "handles embeddings beyond 65535 dimensions" do
+    values = Array.new(100_000) { |i| (i % 7) - 3.0 }
+    obj = RagEmbeddings::Embedding.from_array(values)
+    expect(obj.dim).to eq 100_000
+    expect(obj.to_a).to eq values
+    expect(RagEmbeddings::Embedding.from_json_array("[#{values.join(",")}]").cosine_similarity(obj)).to be_within(1e-6).of(1.0)
+  end
+
+  it "creates embeddings in bulk in a shared arena" do
+    arrays = [[1.0, 2.0, 3.0], [0.5, -1.0], [4.0, 0.0, 0.0, 1.0]]
+    objs = RagEmbeddings::Embedding.from_arrays(arrays)
+    expect(objs.map(&:to_a)).to eq arrays
+    expect(RagEmbeddings::Embedding.from_blobs(arrays.map { |a| a.pack("f*") }).map(&:to_a)).to eq arrays
+
+    kept = objs.first
+    objs = nil
+    GC.start
+    expect(kept.cosine_similarity(RagEmbeddings::Embedding.from_array(arrays.first))).to be_within(1e-6).of(1.0)
+    expect { RagEmbeddings::Embedding.from_arrays([[1.0], [1.0, "a"]]) }.to raise_error(TypeError)
+  end
+
+  it "parses a JSON array of floats straight into a C embedding object" do
+    json = File.read("spec/fixtures/text1_embeddings.json")
+    expected = RagEmbeddings::Embedding.from_array(JSON.parse(json).fetch("embeddings"))
+
+    expect(RagEmbeddings::Embedding.from_json_array(json, "embeddings").to_a).to eq expected.to_a
+    expect(RagEmbeddings::Embedding.from_json_array("[1, -2.5e-3, 3E2]").to_a).to eq [1.0, -2.5e-3, 300.0].pack("f*").unpack("f*")
+    expect { RagEmbeddings::Embedding.from_json_array("[1, \"a\"]") }.to raise_error(ArgumentError)
+    expect { RagEmbeddings::Embedding.from_json_array("[]") }.to raise_error(ArgumentError)
+  end
+
   it "inserts and reads embeddings in sqlite" do
     emb = RagEmbeddings.embed(text1)
     db.insert(text1, emb)
@@ -70,6 +101,15 @@ RSpec.describe RagEmbeddings do
     expect(sim).to be >= -1.0
   end
 
+  it "loads the stored embeddings" do
+    db.insert(text1, RagEmbeddings.embed(text1))
+    id, content, embedding = db.embeddings.first
+    expect(id).to be_a(Integer)
+    expect(content).to eq(text1)
+    expect(embedding).to be_a(RagEmbeddings::Embedding)
+    expect(embedding.dim).to eq RagEmbeddings.embed(text1).size
+  end
+
   it "finds the most similar text for a query" do
     db.insert(text1, RagEmbeddings.embed(text1))
     db.insert(text2, RagEmbeddings.embed(text2))
@@ -79,4 +119,126 @@ RSpec.describe RagEmbeddings do
     expect(result.first[1]).to eq(text1)
     expect(result.first[2]).to be_a(Float)
   end
+  it "reports where the time of a search went" do
+    db.insert(text1, RagEmbeddings.embed(text1))
+    db.insert(text2, RagEmbeddings.embed(text2))
+    stats = RagEmbeddings::SearchStats.new
+
+    result = db.top_k_similar(text1, k: 1, stats:)
+    expect(result.first[1]).to eq(text1)
+    expect(stats.rows_scanned).to eq 2
+    expect(stats.bytes_read).to eq 2 * 4 * RagEmbeddings.embed(text1).size
+    expect(stats.total_time).to be >= stats.scoring_time + stats.fetch_time
+    expect(db.explain(text1, k: 1).to_s).to include("rows_scanned")
+  end
+
+  it "searches an in-memory index kept in sync with the table" do
+    indexed = RagEmbeddings::Database.new(db_path, index: true)
+    indexed.insert(text1, RagEmbeddings.embed(text1))
+    indexed.insert_many([[text2, RagEmbeddings.embed(text2)]])
+
+    expect(indexed.top_k_similar(text1, k: 2).map { |row| row[1] }).to eq [text1, text2]
+    expect(indexed.explain(text1, k: 1).backend).to eq "memory index"
+
+    id = indexed.top_k_similar(text1, k: 1).first.first
+    expect(indexed.delete(id)).to be true
+    expect(indexed.top_k_similar(text1, k: 2).map { |row| row[1] }).to eq [text2]
+    expect(indexed.reload_index.top_k_similar(text2, k: 2).size).to eq 1
+  end
+
+  it "deletes many rows from the table and the index at once" do
+    indexed = RagEmbeddings::Database.new(db_path, index: true)
+    ids = [text1, text2, "A third text"].map { |text| indexed.insert(text, RagEmbeddings.embed(text)) }
+
+    expect(indexed.delete_many(ids.first(2) + [ids.max + 1])).to eq 2
+    expect(indexed.all.map { |row| row[0] }).to eq [ids.last]
+    expect(indexed.top_k_similar(text1, k: 3).map(&:first)).to eq [ids.last]
+  end
+
+  it "filters a search on metadata before scoring" do
+    [db, RagEmbeddings::Database.new(":memory:", index: true)].each do |database|
+      database.insert(text1, RagEmbeddings.embed(text1), tenant_id: "big", tags: %w[faq], created_at: 100)
+      database.insert(text2, RagEmbeddings.embed(text2), tenant_id: "small", tags: %w[faq news], created_at: 200)
+
+      expect(database.top_k_similar(text1, k: 1, where: { tenant_id: "small" }).first[1]).to eq(text2)
+      expect(database.top_k_similar(text1, k: 2, where: { tags: %w[faq news] }).map { |row| row[1] }).to eq [text2]
+      expect(database.top_k_similar(text1, k: 2, where: { created_at: ...200 }).map { |row| row[1] }).to eq [text1]
+      expect(database.explain(text1, k: 2, where: { tenant_id: "small" }).rows_scanned).to eq 1
+      expect { database.top_k_similar(text1, where: { color: "red" }) }.to raise_error(ArgumentError)
+    end
+  end
+
+  it "keeps collections of different dimensions and metrics apart" do
+    small = db.collection("small", dim: 2)
+    large = db.collection("large", metric: :dot, index: true)
+    small.insert("east", [1.0, 0.0])
+    small.insert("north", [0.0, 1.0])
+    large.insert("short", [1.0, 1.0, 1.0])
+    large.insert("long", [2.0, 2.0, 2.0])
+
+    expect(small.top_k_similar([1.0, 0.1], k: 1).first[1]).to eq("east")
+    expect(large.top_k_similar([1.0, 1.0, 1.0], k: 2).map { |row| [row[1], row[2]] }).to eq [["long", 6.0], ["short", 3.0]]
+    expect(db.collections).to eq %w[large small]
+    expect(large.dim).to eq 3
+    expect { small.insert("up", [0.0, 0.0, 1.0]) }.to raise_error(ArgumentError)
+    expect { db.collection("small", metric: :dot) }.to raise_error(ArgumentError)
+    expect(db.collection("large", metric: "dot", dtype: "float32")).to be large
+    expect(db.top_k_similar([1.0, 0.0], k: 5)).to eq []
+
+    expect(db.drop_collection("small")).to be true
+    expect(db.collections).to eq %w[large]
+  end
+
+  it "skips duplicate rows on insert with dedup:" do
+    id = db.insert("Refund policy", [1.0, 0.0, 0.0])
+
+    expect(db.insert("Refund policy", [0.0, 1.0, 0.0], dedup: :exact)).to be_nil
+    expect(db.insert_many([["Refund policy, again", [1.0, 0.01, 0.0]], ["Returns", [0.0, 1.0, 0.0]],
+                           ["Returns, again", [0.0, 1.0, 0.01]]], dedup: :near)).to eq 1
+    expect { db.insert("Refunds", [1.0, 0.0, 0.0], dedup: :near) }.to raise_error(ArgumentError)
+    expect(db.insert_many([["Shipping", [0.0, 0.0, 1.0]], ["Shipping", [0.0, 0.0, 1.0]]], dedup: :exact)).to eq 1
+    expect(db.insert("Refund policy", [1.0, 0.0, 0.0])).to be > id
+    expect(db.all.map { |row| row[1] }).to eq ["Refund policy", "Returns", "Shipping", "Refund policy"]
+  end
+
+  it "fuses BM25 and vector rankings in a hybrid search" do
+    db.insert("Error ERR-4012: disk full", [1.0, 0.0, 0.0])
+    db.insert("Disk usage guide", [0.9, 0.1, 0.0])
+    db.insert("Password reset", [0.0, 1.0, 0.0])
+
+    expect(db.hybrid_search("ERR-4012", [0.9, 0.1, 0.0], k: 2).map { |row| row[1] }).to eq ["Error ERR-4012: disk full", "Disk usage guide"]
+    expect(db.hybrid_search("password", [1.0, 0.0, 0.0], k: 1, alpha: 0.0).first[1]).to eq("Password reset")
+    expect(db.hybrid_search("password", [1.0, 0.0, 0.0], k: 1, alpha: 1.0).first[1]).to eq("Error ERR-4012: disk full")
+  end
+
+  it "fuses rankings natively" do
+    rankings = [[[1, 9.0], [2, 5.0], [3, 1.0]], [[3, 0.9], [1, 0.8]]]
+
+    expect(RagEmbeddings.fuse(rankings, k: 3).map(&:first)).to eq [1, 3, 2]
+    expect(RagEmbeddings.fuse(rankings, k: 2, method: :weighted, weights: [0.3, 0.7])).to eq [[3, 0.7], [1, 0.3]]
+  end
+
+  it "re-ranks candidates by maximal marginal relevance" do
+    candidates = [[1.0, 0.05, 0.0], [1.0, 0.06, 0.0], [0.7, 0.0, 0.7]]
+
+    expect(RagEmbeddings.mmr([1.0, 0.0, 0.0], candidates, k: 2).map(&:first)).to eq [0, 2]
+    expect(RagEmbeddings.mmr([1.0, 0.0, 0.0], candidates, k: 2, lambda: 1.0).map(&:first)).to eq [0, 1]
+    expect(RagEmbeddings.mmr([1.0, 0.0, 0.0], [[2.0, 0.0, 0.0], [0.5, 0.0, 0.0]], k: 1, metric: :dot)).to eq [[0, 2.0]]
+    expect { RagEmbeddings.mmr([1.0, 0.0], candidates, k: 2) }.to raise_error(ArgumentError)
+  end
+
+  it "returns diverse results with mmr_search" do
+    db.insert("Reset your password", [1.0, 0.05, 0.0])
+    db.insert("Reset your password again", [1.0, 0.06, 0.0])
+    db.insert("Account recovery", [0.7, 0.0, 0.7])
+
+    expect(db.mmr_search([1.0, 0.0, 0.0], k: 2).map { |row| row[1] }).to eq ["Reset your password", "Account recovery"]
+  end
+
+  it "reports how the extension was built" do
+    info = RagEmbeddings.build_info
+    expect(info[:profile]).to be_a(String)
+    expect(info[:kernel_variant]).to be_a(String)
+    expect([true, false]).to include(info[:target_clones])
+  end
 end
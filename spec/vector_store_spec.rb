@@ -0,0 +1,251 @@
+require "spec_helper"
+require "rag_embeddings"
+require "timeout"
+require "tmpdir"
+
+RSpec.describe RagEmbeddings::VectorStore do
+  let(:store) { described_class.new(3) }
+
+  before do
+    store.add(10, [1.0, 0.0, 0.0])
+    store.add(11, [0.0, 1.0, 0.0])
+    store.add_packed(12, [1.0, 1.0, 0.0].pack("f*"))
+    store.add(13, RagEmbeddings::Embedding.from_array([-1.0, 0.0, 0.0]))
+  end
+
+  it "returns the exact top-k by decreasing cosine similarity" do
+    results = store.search([1.0, 0.1, 0.0], 3)
+
+    expect(results.map(&:first)).to eq [10, 12, 11]
+    expect(results.first.last).to be_within(1e-6).of(
+      RagEmbeddings::Embedding.from_array([1.0, 0.1, 0.0]).cosine_similarity(RagEmbeddings::Embedding.from_array([1.0, 0.0, 0.0]))
+    )
+  end
+
+  it "accepts an Embedding query and caps k at the store size" do
+    query = RagEmbeddings::Embedding.from_array([-1.0, 0.0, 0.0])
+    results = store.search(query, 10)
+
+    expect(results.size).to eq 4
+    expect(results.first).to eq [13, 1.0]
+  end
+
+  it "rejects vectors of the wrong dimension without adding them" do
+    expect { store.add(14, [1.0, 2.0]) }.to raise_error(ArgumentError)
+    expect { store.add_packed(14, [1.0].pack("f*")) }.to raise_error(ArgumentError)
+    expect { store.add(14, [1.0, "a", 2.0]) }.to raise_error(TypeError)
+    expect(store.size).to eq 4
+  end
+
+  it "ranks like cosine_similarity with the kernels specialized for common sizes" do
+    random = Random.new(7)
+    [384, 1536].each do |dim|
+      vectors = Array.new(50) { Array.new(dim) { random.rand - 0.5 } }
+      sized = RagEmbeddings::VectorStore.new(dim)
+      vectors.each_with_index { |vector, id| sized.add(id, vector) }
+      query = RagEmbeddings::Embedding.from_array(vectors[3])
+
+      expected = vectors.each_with_index.map do |vector, id|
+        [id, query.cosine_similarity(RagEmbeddings::Embedding.from_array(vector))]
+      end.max_by(5) { |_, score| score }
+      results = sized.search(query, 5)
+
+      expect(results.map(&:first)).to eq expected.map(&:first)
+      results.zip(expected).each { |(_, score), (_, cosine)| expect(score).to be_within(1e-6).of(cosine) }
+    end
+  end
+
+  it "ranks by the raw inner product with the dot metric" do
+    dot = described_class.new(2, metric: :dot)
+    dot.add(1, [1.0, 0.0])
+    dot.add(2, [3.0, 3.0])
+
+    expect(dot.metric).to eq :dot
+    expect(dot.search([1.0, 0.0], 2)).to eq [[2, 3.0], [1, 1.0]]
+    expect { described_class.new(2, metric: :l2) }.to raise_error(ArgumentError)
+  end
+
+  it "answers a batch of queries like one search per query" do
+    queries = [[1.0, 0.1, 0.0], [-1.0, 0.0, 0.0], [0.2, 1.0, 0.0], [1.0, 1.0, 0.0], [0.0, 0.0, 1.0]]
+
+    expect(store.search_batch(queries, 2)).to eq(queries.map { |query| store.search(query, 2) })
+    expect(store.search_batch([])).to eq []
+  end
+
+  it "raises instead of scanning a store that was never initialized" do
+    uninitialized = described_class.allocate
+
+    expect { uninitialized.search_batch([[1.0]], 1) }.to raise_error(RuntimeError, /not initialized/)
+    expect { uninitialized.search([1.0], 1) }.to raise_error(RuntimeError, /not initialized/)
+    expect { uninitialized.add(1, []) }.to raise_error(RuntimeError, /not initialized/)
+    expect { uninitialized.similarity_join(threshold: 0.5).to_a }.to raise_error(RuntimeError, /not initialized/)
+  end
+
+  it "yields every pair above the threshold once" do
+    store.add(14, [1.0, 0.05, 0.0])
+
+    pairs = store.similarity_join(threshold: 0.7).map { |id_a, id_b, _| [id_a, id_b] }
+    expect(pairs).to contain_exactly([10, 12], [10, 14], [11, 12], [12, 14])
+    expect(store.similarity_join(threshold: 0.99).to_a).to match [[10, 14, be_within(1e-6).of(0.99875)]]
+  end
+
+  it "never prunes a real pair with the dot metric across tiles" do
+    random = Random.new(7)
+    vectors = Array.new(1300) { |i| Array.new(32) { (random.rand - 0.5) * (i % 97 == 0 ? 2.0 : 0.3) } }
+    vectors[100] = [1.0] * 32
+    vectors[1050] = [10.0] * 32
+    dot_store = described_class.new(32, metric: :dot)
+    vectors.each_with_index { |vector, id| dot_store.add(id, vector) }
+
+    expected = vectors.each_index.to_a.combination(2).select do |a, b|
+      vectors[a].zip(vectors[b]).sum { |x, y| x * y } >= 2.0
+    end
+    stats = {}
+    pairs = dot_store.similarity_join(threshold: 2.0, stats:).map { |id_a, id_b, _| [id_a, id_b] }
+    expect(pairs).to match_array(expected)
+    expect(pairs).to include([100, 1050])
+    expect(dot_store.similarity_join(threshold: 100.0, stats:).to_a).to eq [[100, 1050, 320.0]]
+    expect(stats[:tiles_pruned]).to be > 0
+  end
+
+  it "coalesces concurrent searches into batches" do
+    scheduler = RagEmbeddings::BatchScheduler.new(store, window: 0.01, max_batch: 3)
+    queries = [[1.0, 0.1, 0.0], [-1.0, 0.0, 0.0], [0.2, 1.0, 0.0], [1.0, 1.0, 0.0], [0.0, 1.0, 0.1]]
+
+    results = queries.each_with_index.map { |query, i| Thread.new { scheduler.search(query, i + 1) } }.map(&:value)
+    expect(results).to eq(queries.each_with_index.map { |query, i| store.search(query, i + 1) })
+    expect { scheduler.search([1.0, 0.0]) }.to raise_error(ArgumentError)
+  end
+
+  it "fails every caller of a batch whose leader is interrupted" do
+    interrupted = Class.new do
+      def dim = 3
+
+      def search_batch(*)
+        sleep 0.05
+        raise Interrupt
+      end
+    end
+    scheduler = RagEmbeddings::BatchScheduler.new(interrupted.new, window: 0.05, max_batch: 3)
+
+    errors = Array.new(3) do
+      Thread.new do
+        scheduler.search([1.0, 0.0, 0.0], 1)
+      rescue Interrupt, RagEmbeddings::BatchScheduler::Aborted => e
+        e.class
+      end
+    end.map(&:value)
+    expect(errors).to contain_exactly(Interrupt, RagEmbeddings::BatchScheduler::Aborted, RagEmbeddings::BatchScheduler::Aborted)
+  end
+
+  it "hands the queued searches to a new leader when the leader is interrupted while collecting" do
+    scheduler = RagEmbeddings::BatchScheduler.new(store, window: 0.5)
+
+    leader = Thread.new do
+      Timeout.timeout(0.05) { scheduler.search([1.0, 0.0, 0.0], 1) }
+    rescue Timeout::Error => e
+      e.class
+    end
+    sleep 0.01
+    queued = Thread.new { scheduler.search([0.0, 1.0, 0.0], 1) }
+    expect(leader.value).to eq Timeout::Error
+    expect(queued.join(2)&.value).to eq [[11, 1.0]]
+    expect(Thread.new { scheduler.search([1.0, 0.0, 0.0], 1) }.join(2)&.value).to eq [[10, 1.0]]
+  end
+
+  it "deletes rows by id" do
+    expect(store.delete(12)).to be true
+    expect(store.delete(12)).to be false
+    expect(store.size).to eq 3
+    expect(store.search([1.0, 1.0, 0.0], 3).map(&:first)).to eq [10, 11, 13]
+  end
+
+  it "deletes many rows by id, copying them once while searches read them" do
+    random = Random.new(5)
+    vectors = Array.new(600) { Array.new(8) { random.rand - 0.5 } }
+    one_by_one = described_class.new(8)
+    in_bulk = described_class.new(8)
+    vectors.each_with_index do |vector, id|
+      one_by_one.add(id, vector)
+      in_bulk.add(id, vector)
+    end
+    doomed = (0...600).select { |id| (id % 3).zero? } + [1_000]
+
+    doomed.each { |id| one_by_one.delete(id) }
+    expect(in_bulk.delete_many(doomed)).to eq 200
+    expect(in_bulk.delete_many(doomed)).to eq 0
+    expect(in_bulk.size).to eq 400
+    vectors.first(20).each do |vector|
+      expect(in_bulk.search(vector, 5)).to eq one_by_one.search(vector, 5)
+    end
+    expect(in_bulk.delete(1)).to be true
+    expect(in_bulk.search(vectors[1], 1).first.first).not_to eq 1
+    expect { in_bulk.delete_many(["x"]) }.to raise_error(TypeError)
+  end
+
+  it "scores only the rows whose id is in the filter" do
+    stats = {}
+    results = store.search([1.0, 0.1, 0.0], 3, stats, filter: RagEmbeddings::Bitmap.new([11, 13]))
+
+    expect(results.map(&:first)).to eq [11, 13]
+    expect(stats[:rows_scanned]).to eq 2
+    expect(store.search([1.0, 0.1, 0.0], 3, filter: RagEmbeddings::Bitmap.new)).to eq []
+  end
+
+  it "keeps searching a consistent snapshot while other threads write" do
+    dim = 256
+    random = Random.new(3)
+    vectors = Array.new(1_000) { Array.new(dim) { random.rand - 0.5 } }
+    big = described_class.new(dim)
+    vectors.each_with_index { |vector, id| big.add(id, vector) }
+
+    writer = Thread.new do
+      500.times do |i|
+        big.add(1_000 + i, vectors[i])
+        big.delete(i) if i.even?
+      end
+    end
+    searches = Array.new(4) { Thread.new { Array.new(20) { big.search(vectors[1], 1).first } } }.flat_map(&:value)
+    writer.join
+
+    searches.each do |id, score|
+      expect([1, 1_001]).to include(id)
+      expect(score).to be_within(1e-6).of(1.0)
+    end
+    expect(big.size).to eq 1_250
+  end
+
+  it "saves to a file that maps back as a shared read-only store" do
+    Dir.mktmpdir do |dir|
+      path = File.join(dir, "store.bin")
+      store.save(path)
+      mapped = described_class.map(path)
+
+      expect(mapped).to be_frozen
+      expect(mapped.size).to eq 4
+      expect(mapped.search([1.0, 0.1, 0.0], 4)).to eq store.search([1.0, 0.1, 0.0], 4)
+      expect { mapped.add(14, [1.0, 0.0, 0.0]) }.to raise_error(FrozenError)
+
+      shared = RagEmbeddings::SharedStore.new(path, check_interval: 0)
+      replacement = described_class.new(3)
+      replacement.add(99, [0.0, 0.0, 1.0])
+      RagEmbeddings::SharedStore.publish(replacement, path)
+      expect(shared.search([0.0, 0.0, 1.0], 1).first.first).to eq 99
+      expect(shared.generation).to eq 2
+      expect(mapped.size).to eq 4
+    end
+  end
+
+  it "publishes the store of an empty collection" do
+    Dir.mktmpdir do |dir|
+      path = File.join(dir, "store.bin")
+      db = RagEmbeddings::Database.new(":memory:")
+      expect { RagEmbeddings::SharedStore.publish(db.vector_store, path) }.to raise_error(ArgumentError, /Nothing to publish/)
+
+      RagEmbeddings::SharedStore.publish(db.collection("articles", dim: 3).vector_store, path)
+      shared = RagEmbeddings::SharedStore.new(path)
+      expect(shared.dim).to eq 3
+      expect(shared.search([1.0, 0.0, 0.0], 1)).to eq []
+    end
+  end
+end